@@ -17,7 +17,7 @@ REM Include Flags
 set includeFlags=-I./include
 
 REM Libs
-set libs=-Lbin
+set libs=-Lbin -lws2_32
 
 echo ------------------------------
 echo C++ build script for %outputName%
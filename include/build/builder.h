@@ -9,32 +9,82 @@
 namespace ymk::build
 {
 
+struct BuildOptions
+{
+    usize jobs = 0; // 0 -> hardware_concurrency
+
+    // compile stale TUs from the -E output the cache check already made,
+    // instead of preprocessing them a second time
+    bool compile_preprocessed = false;
+
+    // ignore linemarkers/whitespace when hashing the -E output,
+    // line shifts in headers stop rebuilding (see README for the caveats)
+    bool normalize_hash = false;
+
+    // sources and includes relative to the workspace root, the root mapped to "."
+    // in the compiler's output: two checkouts run the same commands and share objects
+    bool relative_paths = false;
+
+    // content-addressed object store shared with other workspaces, empty -> none
+    string store_dir;
+    u64 store_size = ObjectStore::DEFAULT_MAX_SIZE;
+
+    // http:// cache shared between machines (see RemoteCache), empty -> none
+    string remote_url;
+    bool remote_read_only  = false; // fetch, never upload
+    usize remote_transfers = RemoteCache::DEFAULT_TRANSFERS;
+};
+
+// per-project scheduling state (defined in builder.cpp)
+struct ProjectJob;
+
 class Builder
 {
 private:
     Workspace &workspace;
-    // ThreadPool thread_pool;
+    BuildOptions options;
     Cache cache;
+    string root; // the working directory, the workspace's
+    ThreadPool thread_pool; // declared last so workers join before the cache dies
+
+    // orders projects so every 'use:' dependency comes first,
+    // returns false (and logs the cycle) if the graph isn't a DAG
+    bool sort_projects(vector<Project*> &order);
+
+    // merges configs and queues the out-of-date TUs of the resolved sources
+    void schedule_project(ProjectJob &job, const string &config_name);
+
+    // called once per finished compile / dependency link,
+    // the last one in queues the link step
+    void finish_task(ProjectJob &job);
 
-    // builds a single project
-    void build_project(Project &proj, const string &config_name);
+    void link_project(ProjectJob &job);
 
     // helpers
-    string get_obj_path(const Project &proj, const string &srcfile);
+    string get_out_path(const Project &proj);
+    string get_obj_dir(const Project &proj, const Config &conf, const string &config_name);
+    string get_obj_path(const string &obj_dir, const string &srcfile);
 
-    void compile_file(
-        const Project &proj,
-        const Config  &conf,
-        const string  &src,
-        const string  &obj
+    // removes the project's object directories with another fingerprint
+    // (left behind by a flag edit) and forgets their cache entries
+    void prune_obj_dirs(const Project &proj, const string &config_name, const string &keep);
+
+    // path relative to root if it lies below it (relative_paths only), as is otherwise
+    string workspace_path(const string &path);
+
+    // preprocessed: optional -E output of src to compile instead of src
+    bool compile_file(
+        const CompileTemplate &tmpl,
+        const string          &src,
+        const string          &obj,
+        const string          &preprocessed = ""
     );
 
 public:
-    Builder(Workspace &ws);
+    Builder(Workspace &ws, const BuildOptions &opts = {});
 
     // main event
-    void build(const string &config_name = "debug");
+    bool build(const string &config_name = "debug");
 };
 
 } // namespace ymk::build
-
@@ -5,39 +5,170 @@
 
 #include <core/typedefs.h>
 #include <core/toolchain.h>
+#include <core/stat.h>
+#include <build/hash.h>
+#include <build/cache_file.h>
+#include <build/include_scanner.h>
+#include <build/glob_cache.h>
+#include <build/object_store.h>
+#include <build/remote_cache.h>
 
 #include <unordered_map>
+#include <unordered_set>
+#include <mutex>
 using std::unordered_map;
+using std::unordered_set;
 
 namespace ymk::build
 {
 
-struct FileCache {
-    size_t hash;
-    time_t timestamp;
-};
-
 class Cache {
+public:
+    // filesystem timestamp granularity (the kernel's coarse clock, FAT's 2s)
+    static constexpr u64 RACY_NS = 2000000000ull;
+
 private:
     string cache_path;
+
+    // compacted entries, mapped from .ymake.cache
+    CacheFile base;
+
+    // everything since the last compaction, replayed from .ymake.journal on load.
+    // registry overrides base, erased hides base entries that were dropped
+    CacheJournal journal;
     unordered_map<string, FileCache> registry;
+    unordered_set<string> erased;
+
+    // checked as stale, waiting for the compile to finish (see commit)
+    unordered_map<string, FileCache> pending;
+
+    // compile jobs report back from worker threads
+    std::mutex registry_mutex;
+
+    // content hashes read this run, a header shared by many TUs is read once
+    struct KnownContent {
+        FileStamp stamp;
+        Hash128 hash;
+    };
+    unordered_map<string, KnownContent> contents;
+    std::mutex contents_mutex;
+
+    // the hash to record next to stamp, empty unless stamp is older than before_ns
+    // (minus RACY_NS) and the file still has it after reading: only then are the
+    // bytes known to be what was stamped, and what a compile started at before_ns read
+    Hash128 content_hash(const string &path, const FileStamp &stamp, u64 before_ns);
+
+    // keep each stale TU's -E output next to its object for the compile step
+    bool keep_preprocessed = false;
+
+    // hash the -E token stream, not its layout (linemarkers, whitespace)
+    bool normalize = false;
+
+    // adopts objects left without a record, shared by every TU of the run
+    IncludeScanner include_scanner;
+
+    // src: results, kept in .ymake.globs
+    GlobCache globs;
+
+    // objects shared with other workspaces and machines (both optional),
+    // keys of the TUs compiling right now
+    ObjectStore store;
+    RemoteCache remote;
+    unordered_map<string, Hash128> store_keys;
+
+    bool sharing() const { return store.enabled() || remote.enabled(); }
+
+    // the store entry for this TU, empty if it can't be shared
+    Hash128 store_key(const Project &proj, const Config &conf, const Hash128 &input_hash);
+
+    // registry -> erased -> base, caller holds registry_mutex
+    bool lookup(const string &objfile, FileCache &out) const;
+
+    // fold the journal into a fresh .ymake.cache, caller holds registry_mutex
+    void compact();
 
 public:
-    // load cache from disk (ymake.cache)
+    void set_keep_preprocessed(bool keep) { keep_preprocessed = keep; }
+    void set_normalize(bool enable) { normalize = enable; }
+
+    // check the store / remote cache before compiling and fill them after
+    bool open_store(const string &dir, u64 max_size) { return store.open(dir, max_size); }
+    bool open_remote(const string &url, bool read_only, usize transfers) { return remote.open(url, read_only, transfers); }
+    bool shares_outputs() const { return sharing(); }
+    u64 store_hits() const { return store.run_hits(); }
+    u64 store_misses() const { return store.run_misses(); }
+
+    // map .ymake.cache and replay .ymake.journal on top of it (and read .ymake.globs)
     void load(const string &workspace_root);
 
-    // save cache to disk
+    // compact once the journal outgrows the base file (entries are already on disk),
+    // .ymake.globs and the store's stats are written here too
     void save();
 
+    // every project's src: patterns, reused while the directories they were found in don't change
+    vector<vector<string>> resolve_sources(const vector<vector<string>> &pattern_sets) {
+        return globs.resolve_all(pattern_sets);
+    }
+
     // for incremental builds
+    // with keep_preprocessed, *preprocessed receives the kept -E output (if one was made)
     bool needs_recompile(
-        const Project &proj,
-        const Config  &conf,
-        const string  &srcfile
+        const Project         &proj,
+        const Config          &conf,
+        const CompileTemplate &tmpl, // made from proj and conf
+        const string          &srcfile,
+        const string  &objfile,
+        string        *preprocessed = nullptr
     );
 
+    // entries are keyed by object path, which already carries the config and its fingerprint
+    // (see Builder::get_obj_dir), so every mode keeps its own records
+
+    // appends the headers the last build of objfile read (for BatchStat::prefetch)
+    void collect_inputs(const string &objfile, vector<string> &out);
+
     // update cache entry
-    void update(const string &srcfile, size_t new_hash);
+    void update(const string &objfile, FileCache entry);
+
+    // compile succeeded -> store the pending entry with the headers it used.
+    // started_ns: FileStat::now_ns() from before the compiler ran, a file stamped
+    // later than that (minus RACY_NS) may have changed under the compiler and
+    // is recorded as unknown, the next build checks it again
+    void commit(const string &objfile, const vector<string> &deps, u64 started_ns);
+
+    // same, keeping the headers read from the preprocessed output's linemarkers
+    void commit(const string &objfile, u64 started_ns);
+
+    // drop an entry (ex: compile failed), forces a recompile next build
+    void invalidate(const string &objfile);
+
+    // drop every entry of an object directory that was deleted
+    void invalidate_dir(const string &obj_dir);
+
+    // ----- link steps
+    // same record layout under "link:<out>": hash = input list, cmd_hash = link command,
+    // stamp = the output, deps = every object/library the linker reads (with content hashes)
+
+    // true unless the output exists and nothing it was linked from changed,
+    // an input with a new stamp but the same bytes doesn't count
+    bool needs_relink(const CompileCmd &link_cmd, const string &outfile, const vector<string> &inputs);
+
+    // link succeeded -> remember the inputs as they are now
+    void commit_link(const CompileCmd &link_cmd, const string &outfile, const vector<string> &inputs);
+
+    // link failed -> relink next build no matter what
+    void invalidate_link(const string &outfile);
+
+    // ----- shared outputs (object store, remote cache)
+
+    // the link command and the content of every input, empty without a store or remote
+    Hash128 shared_link_key(const CompileCmd &link_cmd, const vector<string> &inputs);
+
+    // local store first, then the remote (a remote hit is kept in the store too)
+    bool fetch_shared(const char *kind, const Hash128 &key, const string &path);
+
+    // hand a fresh output to both
+    void share(const char *kind, const Hash128 &key, const string &path);
 };
 
-} // namespace ymk::build
\ No newline at end of file
+} // namespace ymk::build
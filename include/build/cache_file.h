@@ -0,0 +1,146 @@
+#pragma once
+
+#include <defines.h>
+
+#include <core/stat.h>
+#include <core/mmap.h>
+#include <core/snapshot.h>
+#include <build/hash.h>
+
+#include <cstdio>
+#include <functional>
+#include <unordered_map>
+
+namespace ymk::build
+{
+
+// a header the TU pulled in (or an input of a link), with its stamp at the time we looked
+struct DepStamp {
+    string path;
+    FileStamp stamp;
+    Hash128 hash{}; // content, empty -> not known (see Cache::needs_recompile, Cache::needs_relink)
+};
+
+struct FileCache {
+    Hash128 hash;     // preprocessed content, empty -> not known yet
+    Hash128 cmd_hash; // full compile command line (Toolchain::create_compile_cmd)
+    Hash128 src_hash; // the source's content, empty -> not known
+
+    FileStamp stamp;      // the source itself
+    vector<DepStamp> deps; // headers from the compiler's depfile (or -E linemarkers)
+};
+
+// the compacted, versioned .ymake.cache. mapped read-only at startup, entries are
+// fixed-size records sorted by key hash so a lookup is a binary search, no parsing
+//
+//    [header][entry records][dep records][string blob]
+//
+class CacheFile {
+private:
+    MappedFile file;
+    u32 entry_count = 0;
+    const unsigned char *entries = nullptr;
+    const unsigned char *deps    = nullptr;
+    const unsigned char *strings = nullptr;
+    u64 deps_count   = 0;
+    u64 strings_size = 0;
+
+    bool read_string(u32 offset, u32 length, string &out) const;
+    bool read_entry(u32 index, string *key, FileCache *entry) const;
+
+public:
+    static constexpr u32 VERSION = 4;
+
+    // false (and stays empty) on a missing, foreign or older-version file
+    bool open(const string &path);
+    void close();
+
+    usize size() const { return entry_count; }
+    usize file_size() const { return file.size(); }
+
+    bool find(const string &key, FileCache &out) const;
+    void for_each(const std::function<void(const string &, const FileCache &)> &fn) const;
+
+    // writes path + ".tmp" and renames it over path, readers never see half a file
+    static bool write(const string &path, const vector<std::pair<string, const FileCache *>> &entries);
+};
+
+// append-only log of cache updates since the last compaction. each record is
+// written with a single fwrite + flush and carries a checksum, so a crash or
+// Ctrl-C loses at most the record being written (a torn tail is ignored on replay)
+class CacheJournal {
+private:
+    string path;
+    FILE *out = nullptr;
+    usize bytes   = 0;
+    usize records = 0;
+
+    bool append(u32 type, const string &payload);
+
+public:
+    ~CacheJournal() { close(); }
+
+    // replays existing records through the callbacks, then opens for appending
+    bool open(
+        const string &path,
+        const std::function<void(const string &, FileCache &&)> &on_put,
+        const std::function<void(const string &)> &on_erase
+    );
+    void close();
+
+    bool put(const string &key, const FileCache &entry);
+    bool erase(const string &key);
+
+    // drop every record (after a compaction)
+    bool reset();
+
+    usize size() const { return bytes; }
+    bool empty() const { return records == 0; }
+};
+
+// ----- .ymake.globs
+
+// a path a glob result depends on, as the walk saw it. files and missing paths only
+// keep exists, a directory changed too close to the walk to trust has mtime_ns 0
+struct WatchStamp {
+    string path;
+    FileStamp stamp;
+    bool is_dir = false;
+};
+
+// a directory listing from an earlier run, valid while the directory keeps its stamp
+struct DirRecord {
+    FileStamp stamp;
+    FsSnapshot::Listing entries;
+};
+
+// one glob::resolve_all: its pattern sets (hashed), the paths it depended on, what it found
+struct GlobRecord {
+    Hash128 key;
+    vector<WatchStamp> watched;
+    vector<vector<string>> results;
+};
+
+// small enough to read and rewrite whole, replaced with a rename like .ymake.cache
+//
+//    [header] {dir record} {glob record}
+//
+class GlobFile {
+public:
+    static constexpr u32 VERSION = 2;
+
+    // false (and leaves both empty) on a missing, foreign or damaged file
+    static bool read(
+        const string &path,
+        std::unordered_map<string, DirRecord> &dirs,
+        vector<GlobRecord> &globs
+    );
+
+    static bool write(
+        const string &path,
+        const std::unordered_map<string, DirRecord> &dirs,
+        const vector<GlobRecord> &globs
+    );
+};
+
+} // namespace ymk::build
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <defines.h>
+#include <logger.h>
+
+namespace ymk::build
+{
+
+// the remote cache protocol (see RemoteCache) served from a plain directory:
+// GET/HEAD read <dir>/<path>, PUT writes it. no auth, no eviction, meant for
+// tests and for measuring hit rates and latency without an external service.
+// anyone who can reach it can store any blob under any key and clients link
+// what they fetch, so it listens on the loopback unless told otherwise
+class CacheServer {
+public:
+    // latency_ms delays every request (ex: to stand in for a server across the country).
+    // returns false if the address can't be bound, otherwise serves until killed
+    static bool run(const string &dir, const string &bind_address, u16 port, usize threads, u32 latency_ms = 0);
+};
+
+} // namespace ymk::build
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <defines.h>
+#include <logger.h>
+
+#include <build/cache_file.h>
+
+#include <unordered_map>
+
+namespace ymk::build
+{
+
+// src: results of earlier runs, kept in .ymake.globs. a directory's mtime moves
+// whenever an entry is added, removed or renamed, so a result is reused as is
+// while none of the directories it was walked from changed. otherwise the walk
+// runs again and only the changed directories are listed from disk.
+// NOTE: a symlink retargeted in place doesn't touch its directory, it goes unseen
+class GlobCache {
+private:
+    string path;
+
+    std::unordered_map<string, DirRecord> dirs;
+    vector<GlobRecord> globs; // most recent first
+    bool dirty = false;
+
+public:
+    // a few pattern sets (ex: 'ymk build' with different project filters)
+    static constexpr usize MAX_RECORDS = 8;
+
+    // a directory whose mtime is this close to the walk could still change
+    // within the same timestamp tick (coarse filesystems go up to 2s)
+    static constexpr u64 RACY_NS = 2000000000ull;
+
+    // missing or damaged files just start empty
+    void load(const string &workspace_root);
+    void save();
+
+    // same as glob::resolve_all
+    vector<vector<string>> resolve_all(const vector<vector<string>> &pattern_sets);
+};
+
+} // namespace ymk::build
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <defines.h>
+#include <core/toolchain.h>
+
+namespace ymk::build
+{
+
+// 128-bit content digest, stable across compilers/std libs (unlike std::hash)
+struct Hash128 {
+    u64 lo = 0;
+    u64 hi = 0;
+
+    bool empty() const { return lo == 0 && hi == 0; }
+
+    bool operator==(const Hash128 &other) const { return lo == other.lo && hi == other.hi; }
+    bool operator!=(const Hash128 &other) const { return !(*this == other); }
+
+    // 32 lowercase hex digits, hi first
+    string to_hex() const;
+    static bool from_hex(const string &hex, Hash128 &out);
+};
+
+// streaming XXH3-128 (the reference xxhash.h, vendored in include/xxhash).
+// the state lives inline, a Hasher stays a plain stack object and xxhash.h
+// stays out of every file that includes this one
+class Hasher {
+public:
+    // room for an XXH3_state_t (576 bytes on 64-bit), checked in hash.cpp
+    static constexpr usize STATE_SIZE  = 576;
+    static constexpr usize STATE_ALIGN = 64;
+
+private:
+    alignas(STATE_ALIGN) unsigned char state[STATE_SIZE];
+
+public:
+    Hasher();
+
+    void update(const void *data, usize size);
+
+    // length-prefixed, so a list of strings can't collide by shifting boundaries
+    void update_str(const string &str);
+    void update_u64(u64 value);
+
+    // can be called mid-stream
+    Hash128 digest() const;
+
+    // one-shot helpers, same digest as streaming the same bytes
+    static Hash128 of(const void *data, usize size);
+    static Hash128 of(const string &str);
+};
+
+// whole file content, false if it can't be read
+bool hash_file(const string &path, Hash128 &out);
+
+// program + every argument, length-prefixed so "-a b" != "-ab"
+Hash128 hash_command(const CompileCmd &cmd);
+
+// everything in a merged config that changes how a TU compiles (links/lib_dirs don't)
+Hash128 hash_config(const Project &proj, const Config &config);
+
+} // namespace ymk::build
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <defines.h>
+#include <core/typedefs.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace ymk::build
+{
+
+// finds the headers a TU pulls in without running the compiler.
+// every #include is followed no matter which #if branch it sits in, so the
+// result is a superset of what the preprocessor would read (never misses a header).
+// each file is read once, its directives are shared by every TU that reaches it
+class IncludeScanner {
+private:
+    struct Directive {
+        string name;
+        bool quoted; // "foo.h" also searches the including file's directory
+    };
+
+    struct FileInfo {
+        std::once_flag parsed;
+        bool readable = false;
+        bool computed = false; // #include MACRO, can't follow it
+        vector<Directive> includes;
+    };
+
+    std::mutex files_mutex;
+    std::unordered_map<string, std::shared_ptr<FileInfo>> files;
+
+    // "<from dir>|<search path key>|<\"|<><name>" -> resolved path ("" = not found)
+    std::mutex resolve_mutex;
+    std::unordered_map<string, string> resolved;
+
+    FileInfo &get(const string &path);
+    string resolve(const Directive &inc, const string &from_dir, const vector<string> &include_dirs, const string &dirs_key);
+
+    static void parse(const string &path, FileInfo &info);
+
+public:
+    // where the compiler looks for headers: inc: plus any -I, -isystem, -iquote,
+    // -idirafter (or /I) in the raw flags, in that order
+    static vector<string> search_dirs(const Config &config);
+
+    // every header reachable from src, resolved the way the compiler would.
+    // <...> names outside include_dirs are system headers and skipped (same as -MMD).
+    // false if the result may be incomplete: unreadable file, computed include,
+    // or a "..." include that resolves nowhere (generated, or behind an #if)
+    bool scan(const string &src, const vector<string> &include_dirs, vector<string> &deps);
+};
+
+} // namespace ymk::build
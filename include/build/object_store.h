@@ -0,0 +1,81 @@
+#pragma once
+
+#include <defines.h>
+#include <logger.h>
+
+#include <core/toolchain.h>
+#include <build/hash.h>
+
+#include <atomic>
+
+namespace ymk::build
+{
+
+// counters kept in <store>/stats, summed over every build that used the store
+struct StoreStats {
+    u64 hits      = 0;
+    u64 misses    = 0;
+    u64 stores    = 0;
+    u64 evictions = 0;
+    u64 files     = 0; // exact after an eviction pass, counted up in between
+    u64 size      = 0; // bytes, same
+};
+
+// content-addressed objects shared by every workspace (worktree, branch, config)
+// that points at the same directory, ccache-style. an entry is keyed by the
+// compile command with its paths left out and the hash of the preprocessed TU,
+// so a TU someone already compiled is placed instead of compiled again
+//
+//    <store>/<2 hex>/<30 hex>.o    the objects, mtime = last use (LRU)
+//    <store>/stats                 StoreStats, rewritten under <store>/lock
+//
+class ObjectStore {
+private:
+    string dir;
+    u64 max_size = 0;
+
+    // this run, folded into <store>/stats by flush()
+    std::atomic<u64> hits{0};
+    std::atomic<u64> misses{0};
+    std::atomic<u64> stores{0};
+    std::atomic<u64> stored_bytes{0};
+
+    string entry_path(const Hash128 &key) const;
+
+public:
+    static constexpr u64 DEFAULT_MAX_SIZE = 5ull << 30;
+
+    // eviction goes down to this share of max_size, so the next few builds don't evict again
+    static constexpr u64 EVICT_TO_PERCENT = 90;
+
+    // creates the directory, false (and stays disabled) if it can't
+    bool open(const string &store_dir, u64 max_size = DEFAULT_MAX_SIZE);
+    bool enabled() const { return !dir.empty(); }
+
+    // the compile command (with placeholder paths, see Cache::store_key) and
+    // the compiler binary it runs, so a compiler upgrade doesn't hit old entries
+    static void hash_compile(Hasher &hasher, const CompileCmd &cmd);
+
+    // places the entry at obj: reflink, hardlink or copy, whichever works first.
+    // a hardlinked obj shares its inode with the store, see Builder::compile_file
+    bool fetch(const Hash128 &key, const string &obj);
+
+    // copies a freshly compiled obj in (never a hardlink, nothing that writes obj later may reach the store)
+    void put(const Hash128 &key, const string &obj);
+
+    // folds this run's counters into the stats and evicts the least recently used
+    // entries once the store outgrew max_size
+    void flush();
+
+    u64 run_hits() const { return hits; }
+    u64 run_misses() const { return misses; }
+
+    // ----- 'ymk store'
+    static bool read_stats(const string &store_dir, StoreStats &out);
+    static bool clear(const string &store_dir);
+
+    // "500M", "5G", "1048576" -> bytes, false on anything else
+    static bool parse_size(const string &text, u64 &out);
+};
+
+} // namespace ymk::build
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <defines.h>
+#include <logger.h>
+
+#include <core/http.h>
+#include <core/mt.h>
+#include <build/hash.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace ymk::build
+{
+
+// artifacts on a shared HTTP server, content-addressed with the same keys as the
+// ObjectStore (see Cache::store_key, Cache::link_key):
+//
+//    GET <url>/<kind>/<32 hex>   200 + the bytes, 404 -> miss
+//    PUT <url>/<kind>/<32 hex>   any 2xx -> stored
+//
+// kind is "obj" or "link". any plain HTTP server that can store PUT bodies works,
+// 'ymk cache-server' is a minimal one. a server that fails to answer is dropped
+// for the rest of the run, so a dead cache costs one timeout, not one per TU
+class RemoteCache {
+private:
+    Url url;
+    string url_text;
+    bool read_only = false;
+
+    // at most max_transfers connections exist, idle ones are kept alive for the next transfer
+    usize max_transfers = 0;
+    std::mutex pool_mutex;
+    std::condition_variable pool_cv;
+    vector<std::unique_ptr<HttpConnection>> idle;
+    usize in_use = 0;
+
+    std::atomic<bool> broken{false};
+
+    // uploads don't hold up the build, flush() waits for them
+    std::unique_ptr<ThreadPool> uploads;
+
+    // this run, for the summary
+    std::atomic<u64> hits{0};
+    std::atomic<u64> misses{0};
+    std::atomic<u64> uploaded{0};
+    std::atomic<u64> errors{0};
+    std::atomic<u64> get_count{0};
+    std::atomic<u64> get_ns{0};
+    std::atomic<u64> bytes_down{0};
+    std::atomic<u64> bytes_up{0};
+
+    std::unique_ptr<HttpConnection> acquire();
+    void release(std::unique_ptr<HttpConnection> conn);
+
+    // one exchange, retried once on a fresh connection (a kept-alive one may have timed out)
+    i32 exchange(const string &method, const string &path, const string &body, string *response);
+
+    void fail(const string &what);
+
+public:
+    static constexpr usize DEFAULT_TRANSFERS = 4;
+
+    // false on a malformed url (only http:// is supported)
+    bool open(const string &url, bool read_only, usize max_transfers = DEFAULT_TRANSFERS);
+    bool enabled() const { return max_transfers > 0 && !broken; }
+
+    // downloads into path (written aside and renamed in)
+    bool fetch(const char *kind, const Hash128 &key, const string &path);
+
+    // reads path now, sends it in the background (no-op when read-only)
+    void put(const char *kind, const Hash128 &key, const string &path);
+
+    // waits for the uploads, logs this run's hits, misses and latency
+    void flush();
+};
+
+} // namespace ymk::build
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <defines.h>
+
+namespace ymk {
+
+// stats many files at once and drops the results into FsSnapshot, so the
+// up-to-date checks that follow are memory lookups instead of one syscall
+// round trip each. linux: statx through io_uring in large batches,
+// elsewhere (or if io_uring is unavailable/blocked) a few threads share the list
+class BatchStat {
+public:
+    static constexpr usize RING_ENTRIES = 256;
+
+    // paths the snapshot already knows are skipped, duplicates are fine
+    static void prefetch(const vector<string> &paths);
+};
+
+} // namespace ymk
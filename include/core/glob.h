@@ -10,16 +10,72 @@ namespace stdfs = std::filesystem;
 
 namespace ymk::fs {
 
+// src: patterns, matched one path segment at a time
+//    *       any run of characters inside a segment
+//    ?       one character
+//    [abc]   one of a set, ranges ([a-z]) and negation ([!a] / [^a])
+//    {a,b}   alternatives, may nest, may span segments ({src,lib/gen})
+//    **      any number of whole segments (a segment on its own)
+//    !pat    drop whatever pat matches, pat/** skips walking that subtree
+//    \x      literal x
 class glob
 {
 public:
     // interface
     static vector<string> resolve(const vector<string> &patterns);
 
+    // one result list per pattern set (ex: one per project). every set is
+    // walked in the same pass, each directory listed once, subtrees in parallel.
+    // watched (optional) receives every path the result depends on: the
+    // directories listed, the roots and the plain files that were looked up
+    static vector<vector<string>> resolve_all(
+        const vector<vector<string>> &pattern_sets,
+        vector<string> *watched = nullptr
+    );
+
+    // true if name matches a single-segment pattern (no '/')
+    static bool match_segment(const string &name, const string &pattern);
+
 private:
-    static void match_pattern(const stdfs::path& pattern, vector<string> &results);
-    static bool matches(const string &text, const string &pattern);
+    struct Segment
+    {
+        string text;
+        bool globstar = false; // "**"
+        bool literal  = false; // no wildcard, compare as is
+    };
+
+    // one brace-free pattern, split into segments
+    struct Compiled
+    {
+        vector<Segment> segments;
+        u32 root_len = 0; // leading literal segments, walking starts below them
+        string root;      // those joined ("src/renderer"), "." if none
+        bool exclude = false;
+    };
+
+    // NFA position in a compiled pattern, the set of reachable segment indices
+    using States = vector<u32>;
+
+    static vector<string> expand_braces(const string &pattern);
+    static Compiled compile(const string &pattern, bool exclude);
+
+    static States closure(const Compiled &pat, States states);
+    static States step(const Compiled &pat, const States &states, const string &name);
+    static bool accepts(const Compiled &pat, const States &states);
+    static bool excludes_subtree(const Compiled &pat, const States &states);
+
+    // everything a walk shares, defined in glob.cpp
+    struct Walk;
+
+    // one directory to list, with the state of every pattern that still can match below it
+    struct WalkTask
+    {
+        string dir;
+        vector<std::pair<u32, States>> active; // include index -> states
+        vector<States> exclude_states;         // per exclude, empty once it can't match
+    };
 
+    static void walk(Walk &walk, WalkTask task);
 };
 
-} // namespace ymk::fs
\ No newline at end of file
+} // namespace ymk::fs
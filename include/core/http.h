@@ -0,0 +1,57 @@
+#pragma once
+
+#include <defines.h>
+
+#include <functional>
+
+namespace ymk {
+
+// http://host[:port][/prefix], plain http only (a cache on localhost or the LAN)
+struct Url {
+    string host;
+    u16 port = 80;
+    string prefix; // no trailing '/', may be empty
+
+    static bool parse(const string &text, Url &out);
+};
+
+// one keep-alive HTTP/1.1 connection over a plain socket,
+// just enough for GET/PUT/HEAD of blobs (Content-Length or chunked replies)
+class HttpConnection {
+private:
+    i64 sock = -1; // SOCKET on windows, -1 == INVALID_SOCKET there too
+    string pending; // bytes read past the last response
+
+public:
+    static constexpr i32 TIMEOUT_MS = 10000;
+
+    HttpConnection() = default;
+    HttpConnection(const HttpConnection &) = delete;
+    HttpConnection &operator=(const HttpConnection &) = delete;
+    ~HttpConnection() { close(); }
+
+    bool connect(const Url &url);
+    bool is_open() const { return sock != -1; }
+    void close();
+
+    // status code, 0 if the exchange failed (the connection is closed then).
+    // the server asking to close is honoured after the response is read
+    i32 request(const string &method, const string &host, const string &path, const string &body, string *response_body);
+};
+
+// blocking accept loop, each connection is served on its own pool thread
+class HttpServer {
+public:
+    // returns the status, fills response (only sent for GET)
+    using Handler = std::function<i32(const string &method, const string &path, const string &body, string &response)>;
+
+    static constexpr usize MAX_BODY = 1ull << 30;
+
+    static constexpr const char *LOOPBACK = "127.0.0.1";
+
+    // bind_address is a dotted IPv4 address ("0.0.0.0" for every interface).
+    // false if it can't be bound, otherwise runs until the process ends
+    static bool serve(const string &bind_address, u16 port, usize threads, const Handler &handler);
+};
+
+} // namespace ymk
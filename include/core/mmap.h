@@ -0,0 +1,34 @@
+#pragma once
+
+#include <defines.h>
+
+namespace ymk {
+
+// read-only view of a whole file, nothing is copied or parsed up front
+class MappedFile {
+private:
+    const unsigned char *ptr = nullptr;
+    usize len = 0;
+
+#ifdef IPLATFORM_WINDOWS
+    void *file_handle    = nullptr;
+    void *mapping_handle = nullptr;
+#endif
+
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // false if the file is missing, empty or can't be mapped
+    bool open(const string &path);
+    void close();
+
+    const unsigned char *data() const { return ptr; }
+    usize size() const { return len; }
+    bool is_open() const { return ptr != nullptr; }
+};
+
+} // namespace ymk
@@ -25,9 +25,8 @@ private:
 
 public:
     ThreadPool(size_t threads = 0) : stop(false) {
-        // if (threads == 0) threads = std::thread::hardware_concurrency();
-        // if (threads == 0) threads = 4
-        threads = 1;
+        if (threads == 0) threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 4;
 
         for(size_t i = 0; i < threads; ++i) {
             workers.emplace_back([this] {
@@ -49,8 +48,11 @@ public:
 
                     task();
 
-                    // Task Finished
-                    working_count--;
+                    // Task Finished (decrement under the lock so wait_idle can't miss it)
+                    {
+                        std::unique_lock<std::mutex> lock(this->queue_mutex);
+                        working_count--;
+                    }
                     wait_cv.notify_all(); // Wake up the main thread if it's waiting
                 }
             });
@@ -67,6 +69,8 @@ public:
         condition.notify_one();
     }
 
+    size_t size() const { return workers.size(); }
+
     void wait_idle() {
         std::unique_lock<std::mutex> lock(queue_mutex);
         // Wait until queue is empty AND no threads are working
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <defines.h>
+#include <core/toolchain.h>
+
+#include <functional>
+
+namespace ymk {
+
+struct ProcessResult {
+    bool spawned   = false; // false -> program not found / fork failed
+    i32 exit_code  = -1;
+    i32 signal     = 0;     // terminating signal, 0 if it exited normally
+
+    // resource usage of the child (zeroed where the platform can't tell)
+    f64 user_sec   = 0.0;
+    f64 sys_sec    = 0.0;
+    i64 max_rss_kb = 0;
+
+    bool ok() const { return spawned && exit_code == 0 && signal == 0; }
+};
+
+struct ProcessOptions {
+    string stdout_path; // redirect the child's stdout into this file, empty -> inherit
+
+    // if set, the child's stdout is read through a pipe and handed over in
+    // fixed-size chunks as it arrives (stdout_path is ignored then)
+    std::function<void(const char *data, usize size)> on_stdout;
+};
+
+class Process {
+public:
+    static constexpr usize PIPE_CHUNK = 64 * 1024;
+
+    // runs cmd.program with cmd.args directly (no shell, no quoting) and waits for it
+    static ProcessResult run(const CompileCmd &cmd, const ProcessOptions &opts = {});
+};
+
+} // namespace ymk
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <defines.h>
+#include <core/stat.h>
+
+#include <memory>
+
+namespace ymk {
+
+// what a build run has seen of the filesystem: stat results and directory
+// listings, each queried once and shared by every thread and project.
+// anything the build writes must go through invalidate(), the rest is
+// assumed not to change while the run is going (reset() starts a new one)
+class FsSnapshot {
+public:
+    struct DirEntry {
+        string name;
+        bool is_dir;
+        bool is_file;
+    };
+
+    using Listing = std::shared_ptr<const vector<DirEntry>>;
+
+    static FileStamp stat(const string &path);
+    static bool is_dir(const string &path);
+    static bool is_file(const string &path);
+
+    // stat results gathered elsewhere (see BatchStat), kept if nothing is known yet
+    static bool known(const string &path);
+    static void insert(const string &path, const FileStamp &stamp, bool is_dir);
+
+    // nullptr if dir can't be listed
+    static Listing list(const string &dir);
+
+    // a listing known from elsewhere (see GlobCache), kept if dir wasn't listed yet
+    static void insert_listing(const string &dir, Listing listing);
+
+    // path was written/created/removed: forgets it and its parent's listing,
+    // the siblings' stats stay. a symlink to it is a path of its own and needs
+    // its own call
+    static void invalidate(const string &path);
+
+    // create_directories that knows about the snapshot
+    static bool create_directories(const string &dir);
+
+    // drop everything, the next query goes to the disk again
+    static void reset();
+};
+
+} // namespace ymk
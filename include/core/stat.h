@@ -0,0 +1,30 @@
+#pragma once
+
+#include <defines.h>
+
+namespace ymk {
+
+// cheap identity of a file on disk, used for the up-to-date fast path
+struct FileStamp {
+    u64 mtime_ns = 0;
+    u64 size     = 0;
+    u64 inode    = 0; // 0 where the platform has no inode numbers
+    bool exists  = false;
+
+    bool operator==(const FileStamp &other) const {
+        return exists == other.exists && mtime_ns == other.mtime_ns &&
+               size == other.size && inode == other.inode;
+    }
+    bool operator!=(const FileStamp &other) const { return !(*this == other); }
+};
+
+class FileStat {
+public:
+    // never throws, a missing file gives a stamp with exists == false
+    static FileStamp get(const string &path, bool *is_dir = nullptr);
+
+    // current time on the same scale as FileStamp::mtime_ns
+    static u64 now_ns();
+};
+
+} // namespace ymk
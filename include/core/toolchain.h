@@ -3,6 +3,7 @@
 #include <defines.h>
 #include <core/typedefs.h>
 
+#include <memory>
 #include <optional>
 
 namespace ymk {
@@ -16,30 +17,67 @@ enum class CompilerType {
 
 struct CompileCmd {
     string program; // "clang++" or "cl.exe" etc...
-    vector<string> args; // ["-c", "main.cpp", ...]
+
+    // leading arguments shared by every command of a project (CompileTemplate::flags), may be null
+    std::shared_ptr<const vector<string>> shared_args;
+    vector<string> args; // the rest, after the shared ones ["-c", "main.cpp", ...]
+
+    usize arg_count() const { return (shared_args ? shared_args->size() : 0) + args.size(); }
+
+    // shared_args, then args
+    template <typename Fn>
+    void for_each_arg(Fn &&fn) const {
+        if (shared_args) {
+            for (const auto &arg : *shared_args) fn(arg);
+        }
+        for (const auto &arg : args) fn(arg);
+    }
 
     // to get full shell string
     string to_string() const;
 };
 
+// the part of a project's compile commands that doesn't depend on the TU, built
+// once per project and config. every command made from it shares the flags
+// (standards, includes, defines, flags, optimization, -fPIC), only the source
+// and the outputs are added per TU
+struct CompileTemplate {
+    string program;
+    CompilerType type = CompilerType::Unknown;
+    std::shared_ptr<const vector<string>> flags;
+};
+
 class Toolchain {
 public:
+    // longest command line run as is. windows goes through cmd.exe for now (8191 chars),
+    // elsewhere ARG_MAX is shared with the environment, stay well below it
+#ifdef IPLATFORM_WINDOWS
+    static constexpr usize RESPONSE_FILE_THRESHOLD = 8000;
+#else
+    static constexpr usize RESPONSE_FILE_THRESHOLD = 32 * 1024;
+#endif
+
     static CompilerType detect(const string &compiler_cmd);
 
-    // preprocessing for incremental builds
-    static CompileCmd create_preprocess_cmd(
+    static CompileTemplate create_compile_template(
         const Project &proj,
-        const Config  &conf, // merged config
-        const string  &srcfile,
-        const string  &outfile
+        const Config  &conf // merged config
+    );
+
+    // preprocessing for incremental builds, an empty outfile writes to stdout
+    static CompileCmd create_preprocess_cmd(
+        const CompileTemplate &tmpl,
+        const string          &srcfile,
+        const string          &outfile
     );
 
-    // generate (ex): clang++ -c src/main.cpp
+    // generate (ex): clang++ -std=c++20 -Isrc -c src/main.cpp -o main.o
+    // if preprocessed is set, that file (the -E output of srcfile) is compiled instead
     static CompileCmd create_compile_cmd(
-        const Project &proj,
-        const Config  &conf,
-        const string  &srcfile,
-        const string  &objfile
+        const CompileTemplate &tmpl,
+        const string          &srcfile,
+        const string          &objfile,
+        const string          &preprocessed = ""
     );
 
     // generates the output assembly cmd
@@ -50,6 +88,26 @@ public:
         const string &output_file
     );
 
+    // cmd as it should run: past RESPONSE_FILE_THRESHOLD its arguments go into an
+    // @file in dir (gcc/clang or msvc quoting). only the shared_args if that's enough,
+    // so every TU of a project reads the same one. named after the content, an
+    // existing one is not rewritten. cmd unchanged if the file can't be written
+    static CompileCmd with_response_file(CompilerType type, const CompileCmd &cmd, const string &dir);
+
+    // where the compiler leaves the header list of objfile
+    //    gcc/clang: make-style depfile (-MMD -MF)
+    //    msvc:      captured stdout of /showIncludes
+    static string depfile_path(const string &objfile);
+
+    // headers listed in a depfile, srcfile itself is left out.
+    // for msvc any non-include lines (diagnostics) end up in other_output
+    static vector<string> read_depfile(
+        CompilerType type,
+        const string &depfile,
+        const string &srcfile,
+        string *other_output = nullptr
+    );
+
 private:
 
     // abstraction for different flag syntax
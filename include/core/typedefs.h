@@ -32,6 +32,10 @@ struct Config
     vector<string> links;
     vector<string> lib_dirs;
 
+    // set by the builder with workspace-relative paths, never by build.ymk:
+    // the workspace root, mapped to "." in debug info and __FILE__
+    optional<string> path_root;
+
     inline void merge(Config &other) {
         // overwrite
         if (!other.compiler.empty()) compiler = other.compiler;
@@ -1,9 +1,17 @@
 #include <build/builder.h>
+#include <build/hash.h>
 #include <core/toolchain.h>
-#include <core/glob.h>
+#include <core/process.h>
+#include <core/snapshot.h>
+#include <core/stat.h>
+#include <core/batch_stat.h>
 #include <error.h>
 
 #include <iostream>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <algorithm>
 #include <filesystem>
 #include <unordered_map>
 #include <vector>
@@ -15,8 +23,65 @@ namespace ymk::build {
 // global map for O(1) project lookup during dependency resolution
 static std::unordered_map<string, Project*> project_map;
 
-Builder::Builder(Workspace& ws) : workspace(ws) {
+// libraries the linker will pick up through -l/-L, as far as we can tell without asking it
+// (used projects land in dist_dir, system libs are usually in neither and just don't count)
+// every file name -l<lib> may resolve to
+static vector<string> link_library_names(const string& lib) {
+    return {"lib" + lib + ".so", "lib" + lib + ".dylib", "lib" + lib + ".a", lib + ".lib", lib + ".dll"};
+}
+
+static vector<string> find_link_libraries(const Config& config) {
+    vector<string> found;
+    for (const auto& lib : config.links) {
+        const vector<string> names = link_library_names(lib);
+
+        for (const auto& dir : config.lib_dirs) {
+            for (const auto& name : names) {
+                string path = dir + "/" + name;
+                if (FsSnapshot::is_file(path)) found.push_back(path);
+            }
+        }
+    }
+    return found;
+}
+
+// the linker may write more than out (msvc's import .lib next to a .dll) and a
+// lib<name>.so symlink may point at it: forget every name a dependent links it by
+static void invalidate_link_outputs(const Project& proj, const string& out) {
+    FsSnapshot::invalidate(out);
+
+    string dir = stdfs::path(out).parent_path().string();
+    for (const auto& name : link_library_names(proj.name)) {
+        FsSnapshot::invalidate(dir.empty() ? name : dir + "/" + name);
+    }
+}
+
+struct ProjectJob
+{
+    Project* proj = nullptr;
+    Config config;          // merged config, read-only once compiles are queued
+    CompileTemplate compile; // the TU-independent part of every compile command, from config
+    string obj_dir;         // obj_dir/<config>/<project>-<config fingerprint>
+    vector<string> sources; // src: patterns, resolved for every project in one walk
+    vector<string> objects;
+
+    // projects that link against this one
+    vector<ProjectJob*> dependents;
+
+    // checks/compiles + unlinked dependencies left before the link can run
+    std::atomic<i32> pending{0};
+    std::atomic<i32> compiled{0};
+    std::atomic<bool> ok{true};
+};
+
+Builder::Builder(Workspace& ws, const BuildOptions& opts)
+    : workspace(ws), options(opts), thread_pool(opts.jobs) {
+    root = stdfs::current_path().lexically_normal().string();
     cache.load(".");
+    cache.set_keep_preprocessed(options.compile_preprocessed);
+    cache.set_normalize(options.normalize_hash);
+    if (!options.store_dir.empty()) cache.open_store(options.store_dir, options.store_size);
+    if (!options.remote_url.empty()) cache.open_remote(options.remote_url, options.remote_read_only, options.remote_transfers);
 
     // index projects for fast dependency lookup
     project_map.clear();
@@ -25,29 +90,175 @@ Builder::Builder(Workspace& ws) : workspace(ws) {
     }
 }
 
-void Builder::build(const string& config_name) {
-    // TODO: Implement Topological Sort here to ensure correct build order.
-    // For now, we rely on the definition order in the .ymk file.
-    
-    for (auto& proj : workspace.projects) {
-        build_project(proj, config_name);
+bool Builder::build(const string& config_name) {
+    // stats and listings are shared by the whole run, start from a clean view
+    FsSnapshot::reset();
+
+    vector<Project*> order;
+    if (!sort_projects(order)) return false;
+
+    // create every job up front so dependencies can signal their dependents
+    vector<std::unique_ptr<ProjectJob>> jobs;
+    std::unordered_map<string, ProjectJob*> job_map;
+
+    for (Project* proj : order) {
+        jobs.push_back(std::make_unique<ProjectJob>());
+        ProjectJob& job = *jobs.back();
+        job.proj = proj;
+
+        // +1 guard, released once all of this project's compiles are queued
+        job.pending = 1;
+        job_map[proj->name] = &job;
+
+        for (const string& dep_name : proj->deps) {
+            auto it = job_map.find(dep_name);
+            if (it == job_map.end()) continue; // unknown, reported in schedule_project
+
+            it->second->dependents.push_back(&job);
+            job.pending++;
+        }
+    }
+
+    // one walk over the tree for every project's patterns, not one per project,
+    // skipped entirely when no directory it went through changed since last build
+    vector<vector<string>> pattern_sets;
+    for (auto& job : jobs) pattern_sets.push_back(job->proj->src_globs);
+
+    vector<vector<string>> resolved = cache.resolve_sources(pattern_sets);
+    for (usize i = 0; i < jobs.size(); i++) {
+        jobs[i]->sources = std::move(resolved[i]);
+        for (auto& src : jobs[i]->sources) src = workspace_path(src);
+    }
+
+    // compiles only need headers, so every project starts compiling right away,
+    // only the link steps follow the dependency order
+    for (auto& job : jobs) {
+        schedule_project(*job, config_name);
+    }
+
+    thread_pool.wait_idle();
+
+    bool ok = true;
+    for (auto& job : jobs) {
+        if (!job->ok) ok = false;
     }
     
+    if (cache.store_hits() || cache.store_misses()) {
+        LOGFMT(PROJNAME, "store", CYAN_TEXT("object store: "), cache.store_hits(), " hits, ", cache.store_misses(), " misses\n");
+    }
+
     // save cache at the end
     cache.save();
+    return ok;
+}
+
+bool Builder::sort_projects(vector<Project*>& order) {
+    // DFS post-order, a node seen again while still 'visiting' closes a cycle
+    enum class Mark { None, Visiting, Done };
+    std::unordered_map<string, Mark> marks;
+    vector<string> stack;
+
+    std::function<bool(Project*)> visit = [&](Project* proj) {
+        Mark& mark = marks[proj->name];
+        if (mark == Mark::Done) return true;
+
+        if (mark == Mark::Visiting) {
+            string cycle;
+            auto it = std::find(stack.begin(), stack.end(), proj->name);
+            for (; it != stack.end(); ++it) cycle += *it + " -> ";
+            cycle += proj->name;
+
+            LOGFMT(
+                PROJNAME,
+                "builder",
+                RED_TEXT("[ERROR]: "), "dependency cycle between projects: ", cycle, "\n"
+            );
+            return false;
+        }
+
+        mark = Mark::Visiting;
+        stack.push_back(proj->name);
+
+        for (const string& dep_name : proj->deps) {
+            auto it = project_map.find(dep_name);
+            if (it == project_map.end()) continue;
+            if (!visit(it->second)) return false;
+        }
+
+        stack.pop_back();
+        marks[proj->name] = Mark::Done;
+        order.push_back(proj);
+        return true;
+    };
+
+    for (auto& proj : workspace.projects) {
+        if (!visit(&proj)) return false;
+    }
+
+    return true;
 }
 
-string Builder::get_obj_path(const Project& proj, const string& src) {
-    // ex: src/main.cpp -> build/obj/DoomEngine/main_HASH.o
+string Builder::get_out_path(const Project& proj) {
+    string out_ext = (proj.type == ArtifactType::Exe) ? ".exe" : 
+                        (proj.type == ArtifactType::SharedLib) ? ".dll" : ".lib";
+    return workspace.dist_dir + "/" + proj.name + out_ext;
+}
+
+string Builder::get_obj_dir(const Project& proj, const Config& config, const string& config_name) {
+    // ex: build/obj/debug/DoomEngine-1a2b3c4d5e6f
+    // each mode gets its own objects, switching back is free. a flag edit moves
+    // to a new fingerprint, prune_obj_dirs removes the old one
+    string fingerprint = hash_config(proj, config).to_hex().substr(20);
+    return workspace.obj_dir + "/" + config_name + "/" + proj.name + "-" + fingerprint;
+}
+
+void Builder::prune_obj_dirs(const Project& proj, const string& config_name, const string& keep) {
+    string parent = workspace.obj_dir + "/" + config_name;
+    string prefix = proj.name + "-";
+
+    std::error_code ec;
+    for (stdfs::directory_iterator it(parent, ec), end; !ec && it != end; it.increment(ec)) {
+        string name = it->path().filename().string();
+
+        // exactly <project>-<12 hex>, "eng-tools-..." belongs to another project
+        bool ours = name.size() == prefix.size() + 12 && name.compare(0, prefix.size(), prefix) == 0 &&
+                    std::all_of(name.begin() + prefix.size(), name.end(), [](char c) { return isxdigit((unsigned char)c); });
+
+        string dir = parent + "/" + name;
+        if (!ours || dir == keep || !it->is_directory(ec)) continue;
+
+        std::error_code remove_ec;
+        stdfs::remove_all(dir, remove_ec);
+        cache.invalidate_dir(dir);
+    }
+}
+
+string Builder::get_obj_path(const string& obj_dir, const string& src) {
+    // ex: src/main.cpp -> build/obj/debug/DoomEngine-1a2b3c4d5e6f/main_HASH.o
     
-    // Hash the full path to avoid collisions (e.g. src/main.cpp vs lib/main.cpp)
-    size_t path_hash = std::hash<string>{}(src);
+    // Hash the full path to avoid collisions (e.g. src/main.cpp vs lib/main.cpp),
+    // 64 bits of the stable hash keep names short and identical across std libs
+    string path_hash = Hasher::of(src).to_hex().substr(16);
     string filename = stdfs::path(src).filename().string();
     
-    return workspace.obj_dir + "/" + proj.name + "/" + filename + "_" + std::to_string(path_hash) + ".o";
+    return obj_dir + "/" + filename + "_" + path_hash + ".o";
+}
+
+string Builder::workspace_path(const string& path) {
+    if (!options.relative_paths) return path;
+
+    stdfs::path p(path);
+    if (p.is_relative()) return path;
+
+    // elsewhere (system headers, another drive) stays absolute
+    stdfs::path rel = p.lexically_relative(root);
+    if (rel.empty() || *rel.begin() == "..") return path;
+    return rel.generic_string();
 }
 
-void Builder::build_project(Project& proj, const string& config_name) {
+void Builder::schedule_project(ProjectJob& job, const string& config_name) {
+    Project& proj = *job.proj;
+
     LOGFMT(
         PROJNAME,
         "builder",
@@ -56,7 +267,8 @@ void Builder::build_project(Project& proj, const string& config_name) {
     );
 
     // -------- CONFIGURATION MERGE
-    Config final_config = proj.base_config;
+    Config& final_config = job.config;
+    final_config = proj.base_config;
 
     // Merge global workspace config
     final_config.merge(workspace.global_base_config);
@@ -98,8 +310,15 @@ void Builder::build_project(Project& proj, const string& config_name) {
     // ------------ LINKER FLAGS (OS/Compiler Specific)
     final_config.lib_dirs.push_back(workspace.dist_dir);
 
+    // ------------ WORKSPACE-RELATIVE PATHS
+    if (options.relative_paths) {
+        for (auto& inc : final_config.includes) inc = workspace_path(inc);
+        for (auto& dir : final_config.lib_dirs) dir = workspace_path(dir);
+        final_config.path_root = root;
+    }
+
     // --------- RESOLVE SOURCE FILES
-    std::vector<string> sources = ymk::fs::glob::resolve(proj.src_globs);
+    const vector<string>& sources = job.sources;
     if (sources.empty()) {
         LOGFMT(
             PROJNAME,
@@ -107,75 +326,190 @@ void Builder::build_project(Project& proj, const string& config_name) {
             RED_TEXT("[ERROR]: "),
             "didn't find any source files matching patterns in ", proj.name, "\n"
         );
+        job.ok = false;
+        finish_task(job); // release the guard so dependents hear about it
         return;
     }
 
-    // ------- PREPARE DIRECTORIES
-    stdfs::create_directories(workspace.dist_dir);
-    stdfs::create_directories(workspace.obj_dir + "/" + proj.name);
+    job.compile = Toolchain::create_compile_template(proj, final_config);
 
-    // --------- COMPILE PHASE (Sequential)
-    std::vector<string> object_files;
-    i32 tasks_dispatched = 0;
+    // ------- PREPARE DIRECTORIES
+    FsSnapshot::create_directories(workspace.dist_dir);
+    job.obj_dir = get_obj_dir(proj, final_config, config_name);
+    FsSnapshot::create_directories(job.obj_dir);
+    prune_obj_dirs(proj, config_name, job.obj_dir);
 
+    // --------- PREFETCH
+    // every source, object and header the checks below will stat, in one batch
+    vector<string> inputs;
     for (const auto& src : sources) {
-        string obj = get_obj_path(proj, src);
-        object_files.push_back(obj);
+        string obj = get_obj_path(job.obj_dir, src);
+        inputs.push_back(src);
+        inputs.push_back(obj);
+        cache.collect_inputs(obj, inputs);
+        job.objects.push_back(std::move(obj));
+    }
+    BatchStat::prefetch(inputs);
 
-        // Incremental Build Check
-        if (cache.needs_recompile(proj, final_config, src)) {
-            if (tasks_dispatched == 0) {
-                LOGFMT(PROJNAME, "compile", CYAN_TEXT("Compiling out-of-date files...\n"));
+    // --------- COMPILE PHASE (Parallel)
+    // the up-to-date check runs on the workers too, each one streams its own preprocessor
+    for (usize i = 0; i < sources.size(); i++) {
+        const string& src = sources[i];
+        const string& obj = job.objects[i];
+
+        job.pending++;
+        
+        // hand the TU to the pool, the job outlives the tasks (wait_idle in build)
+        thread_pool.add_task([this, &job, src, obj] {
+            // Incremental Build Check
+            string preprocessed;
+            if (cache.needs_recompile(*job.proj, job.config, job.compile, src, obj, &preprocessed)) {
+                if (job.compiled++ == 0) {
+                    LOGFMT(PROJNAME, "compile", CYAN_TEXT("Compiling out-of-date files in "), job.proj->name, "...\n");
+                }
+
+                if (!this->compile_file(job.compile, src, obj, preprocessed)) {
+                    job.ok = false;
+
+                    // forget the entry so the failed TU is retried next build
+                    cache.invalidate(obj);
+                }
             }
-            
-            tasks_dispatched++;
-            
-            // Compile synchronously directly on the main thread
-            this->compile_file(proj, final_config, src, obj);
+            finish_task(job);
+        });
+    }
+
+    // every check is queued, drop the guard
+    finish_task(job);
+}
+
+void Builder::finish_task(ProjectJob& job) {
+    if (--job.pending != 0) return;
+
+    // last compile (or dependency link) done -> this project may link now
+    thread_pool.add_task([this, &job] {
+        link_project(job);
+
+        // wake up whoever links against us
+        for (ProjectJob* dependent : job.dependents) {
+            if (!job.ok) dependent->ok = false;
+            finish_task(*dependent);
         }
+    });
+}
+
+void Builder::link_project(ProjectJob& job) {
+    const Project& proj = *job.proj;
+
+    if (job.compiled == 0 && job.ok) {
+        LOGFMT(PROJNAME, "compile", GREEN_TEXT(proj.name, " Up to date!\n"));
     }
 
-    if (tasks_dispatched == 0) {
-        LOGFMT(PROJNAME, "compile", GREEN_TEXT("Project Up to date!\n"));
+    if (!job.ok) {
+        LOGFMT(
+            PROJNAME,
+            "link",
+            RED_TEXT("[ERROR]: "), "skipping link of ", proj.name, ", some files or dependencies failed.\n"
+        );
+        return;
     }
 
-    // --------- LINK PHASE (Sequential)
-    if (!object_files.empty()) {
-        string out_ext = (proj.type == ArtifactType::Exe) ? ".exe" : 
-                            (proj.type == ArtifactType::SharedLib) ? ".dll" : ".lib";
-        string out_bin = workspace.dist_dir + "/" + proj.name + out_ext;
+    // --------- LINK PHASE
+    if (!job.objects.empty()) {
+        string out_bin = get_out_path(proj);
         
-        CompileCmd link_cmd = Toolchain::create_link_cmd(proj, final_config, object_files, out_bin);
+        CompileCmd link_cmd  = Toolchain::create_link_cmd(proj, job.config, job.objects, out_bin);
+        vector<string> inputs = job.objects;
+        for (auto& lib : find_link_libraries(job.config)) inputs.push_back(std::move(lib));
+
+        // nothing new to link, the output is what the linker would produce
+        if (!cache.needs_relink(link_cmd, out_bin, inputs)) return;
+
+        // someone linked these exact inputs already (object store / remote cache)
+        Hash128 shared_key = cache.shared_link_key(link_cmd, inputs);
+        if (!shared_key.empty()) {
+            if (cache.fetch_shared("link", shared_key, out_bin)) {
+                invalidate_link_outputs(proj, out_bin);
+                LOGFMT(PROJNAME, "link", CYAN_TEXT("Fetched "), out_bin, "\n");
+                cache.commit_link(link_cmd, out_bin, inputs);
+                return;
+            }
+
+            // it may be a hardlink into the store, same as objects
+            std::error_code ec;
+            stdfs::remove(out_bin, ec);
+        }
         
         LOGFMT(PROJNAME, "link", CYAN_TEXT("Linking "), out_bin, "...\n");
         
-        // Execute Linker using standard system call
-        int ret = std::system(link_cmd.to_string().c_str());
-        if (ret != 0) {
+        // Execute Linker directly (no shell in between), the object list may go in a response file
+        CompilerType type  = Toolchain::detect(job.config.compiler);
+        ProcessResult ret = Process::run(Toolchain::with_response_file(type, link_cmd, job.obj_dir));
+        invalidate_link_outputs(proj, out_bin);
+        if (!ret.ok()) {
             LOGFMT(
                 PROJNAME,
                 "link",
                 RED_TEXT("[ERROR]: "), "linking failed.\n",
-                YELLOW_TEXT("\terror code: "), ret, "\n"
+                YELLOW_TEXT("\terror code: "), ret.exit_code, "\n"
             );
+            job.ok = false;
+            cache.invalidate_link(out_bin);
+            return;
         }
+
+        cache.commit_link(link_cmd, out_bin, inputs);
+        if (!shared_key.empty()) cache.share("link", shared_key, out_bin);
     }
 }
 
-void Builder::compile_file(const Project& proj, const Config& cfg, const string& src, const string& obj) {
-    CompileCmd cmd = Toolchain::create_compile_cmd(proj, cfg, src, obj);
+bool Builder::compile_file(const CompileTemplate& tmpl, const string& src, const string& obj, const string& preprocessed) {
+    CompileCmd cmd    = Toolchain::create_compile_cmd(tmpl, src, obj, preprocessed);
+    CompilerType type = tmpl.type;
+    string depfile    = Toolchain::depfile_path(obj);
     
     LOGFMT(PROJNAME, "build", CYAN_TEXT("[CC] "), src, "\n");
+
+    // a fetched object may be a hardlink into the store, the compiler must not write through it
+    if (cache.shares_outputs()) {
+        std::error_code ec;
+        stdfs::remove(obj, ec);
+    }
+
+    // msvc prints /showIncludes on stdout, capture it as the depfile
+    ProcessOptions opts;
+    if (type == CompilerType::MSVC && preprocessed.empty()) opts.stdout_path = depfile;
     
-    // Execute Compile using standard system call
-    int ret = std::system(cmd.to_string().c_str());
-    if (ret != 0) {
+    // headers saved after this may not be what the compiler read (see Cache::commit)
+    u64 started = FileStat::now_ns();
+
+    // Execute Compile directly (no shell in between), long flags go in a response file
+    ProcessResult ret = Process::run(Toolchain::with_response_file(type, cmd, stdfs::path(obj).parent_path().string()), opts);
+    FsSnapshot::invalidate(obj); // the depfile is read directly, its directory's listing goes too
+
+    vector<string> deps;
+    if (preprocessed.empty()) {
+        string diagnostics;
+        deps = Toolchain::read_depfile(type, depfile, src, &diagnostics);
+        if (!diagnostics.empty()) LLOG(diagnostics);
+    } else {
+        // multi-MB and only needed for this one compile
+        std::error_code ec;
+        stdfs::remove(preprocessed, ec);
+    }
+
+    if (!ret.ok()) {
         LOGFMT(
             PROJNAME,
             "build",
             RED_TEXT("[ERROR]: "), "Compilation Failed: ", src, "\n"
         );
+        return false;
     }
+
+    if (preprocessed.empty()) cache.commit(obj, deps, started);
+    else cache.commit(obj, started);
+    return true;
 }
 
 } // namespace ymk::build
\ No newline at end of file
@@ -1,94 +1,788 @@
 #include <build/cache.h>
+#include <core/process.h>
+#include <core/snapshot.h>
 
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
-#include <sstream>
 #include <functional>
-#include <iomanip>
 
 namespace fs = std::filesystem;
 
 namespace ymk::build
 {
 
-// helper -> run command and get output string (for hashing)
-static string run_and_read(const CompileCmd& cmd, const string& temp_file) {
-    string full_cmd = cmd.to_string();
-    
-    // redirect stdout if toolchain didn't handle file output
-    i32 ret = std::system(full_cmd.c_str());
-    if (ret != 0) return "";
+// compact mid-build too if the journal gets this big, replay time stays bounded
+static constexpr usize MAX_JOURNAL_SIZE = 32 * 1024 * 1024;
 
-    // read the temp file
-    std::ifstream file(temp_file, std::ios::binary);
-    if (!file.is_open()) return "";
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+// below this, replaying is cheaper than rewriting the base file
+static constexpr usize MIN_COMPACT_SIZE = 64 * 1024;
+
+// collects headers from the preprocessor's linemarkers as the output streams by
+//    gcc/clang: # 12 "include/foo.h" 2
+//    msvc:      #line 12 "include\\foo.h"
+// system headers (gcc flag 3) are skipped, same as -MMD.
+// only '#' lines are buffered, so memory stays at one directive
+class LinemarkerScanner {
+private:
+    const string& src;
+    std::unordered_set<string> seen;
+
+    string line;
+    bool at_line_start = true;
+    bool in_directive  = false;
+
+    void scan_line() {
+        // only '# <line>' and '#line', not #pragma
+        size_t p = 1;
+        if (line.compare(p, 4, "line") == 0) p += 4;
+        while (p < line.size() && line[p] == ' ') p++;
+
+        if (p >= line.size() || !isdigit((unsigned char)line[p])) return;
+
+        size_t q = line.find('"', p);
+        if (q == string::npos) return;
+
+        // the path is a C string literal, undo its escapes
+        string path;
+        for (q++; q < line.size() && line[q] != '"'; q++) {
+            if (line[q] == '\\' && q + 1 < line.size()) q++;
+            path += line[q];
+        }
+
+        bool is_system = q < line.size() && line.find('3', q) != string::npos;
+
+        // skip <built-in>, <command-line>, the cwd marker ("dir//") and the TU itself
+        bool is_file = !path.empty() && path[0] != '<' && path.back() != '/';
+        if (is_file && !is_system && path != src && seen.insert(path).second) {
+            deps.push_back(path);
+        }
+    }
+
+public:
+    vector<string> deps;
+
+    LinemarkerScanner(const string& srcfile) : src(srcfile) {}
+
+    void feed(const char* data, usize size) {
+        for (usize i = 0; i < size; i++) {
+            char c = data[i];
+
+            if (c == '\n') {
+                if (in_directive) scan_line();
+                line.clear();
+                at_line_start = true;
+                in_directive  = false;
+                continue;
+            }
+
+            if (at_line_start) in_directive = (c == '#');
+            at_line_start = false;
+
+            if (in_directive) line += c;
+        }
+    }
+
+    void finish() {
+        if (in_directive) scan_line();
+    }
+};
+
+// hashes the preprocessed token stream instead of its layout (opt-in, see README):
+//    - linemarkers (# 12 "foo.h", #line 12) are dropped
+//    - whitespace is dropped unless it keeps two tokens apart ("int x", "+ +")
+//    - string/char literals (raw strings too) are hashed byte for byte
+// so a blank line or a comment in a header doesn't change the TUs that include it
+class TokenNormalizer {
+private:
+    Hasher& hasher;
+    string out;  // batched, the hasher likes big updates
+    string line; // a '#' line, kept until we know if it's a linemarker
+
+    enum class State { Code, String, Char, RawDelim, RawBody };
+    State state = State::Code;
+
+    bool at_line_start = true;
+    bool in_directive  = false;
+    bool pending_space = false;
+    bool escaped       = false;
+
+    char last = 0; // last char emitted outside literals
+    string word;   // identifier/number being emitted, for raw prefixes and 1'000
+    string raw_end;  // ")delim\"" closing the current raw string
+    string raw_tail; // last raw_end.size() chars of its body
+
+    static bool is_word(char c) {
+        return isalnum((unsigned char)c) || c == '_' || c == '"' || c == '\'' || (unsigned char)c >= 0x80;
+    }
+
+    // operator chars that form a different token when glued together (+ + vs ++)
+    static bool joins(char c) {
+        return strchr("+-*/%<>=!&|^:.#", c) != nullptr;
+    }
+
+    void emit(char c) {
+        out += c;
+        if (out.size() >= 16 * 1024) flush();
+    }
+
+    void flush() {
+        hasher.update(out.data(), out.size());
+        out.clear();
+    }
+
+    void code(char c) {
+        switch (state) {
+        case State::String:
+        case State::Char:
+            emit(c);
+            if (escaped) escaped = false;
+            else if (c == '\\') escaped = true;
+            else if (c == (state == State::String ? '"' : '\'')) state = State::Code;
+            return;
+
+        case State::RawDelim:
+            emit(c);
+            if (c == '(') state = State::RawBody;
+            else raw_end.insert(raw_end.size() - 1, 1, c);
+            return;
+
+        case State::RawBody:
+            emit(c);
+            raw_tail += c;
+            if (raw_tail.size() > raw_end.size()) raw_tail.erase(0, raw_tail.size() - raw_end.size());
+            if (raw_tail == raw_end) state = State::Code;
+            return;
+
+        case State::Code:
+            break;
+        }
+
+        if (isspace((unsigned char)c)) {
+            pending_space = last != 0;
+            word.clear();
+            return;
+        }
+
+        if (pending_space) {
+            pending_space = false;
+            if ((is_word(last) && is_word(c)) || (joins(last) && joins(c))) emit(' ');
+        }
+
+        if (c == '"') {
+            bool raw = !word.empty() && word.back() == 'R' &&
+                       (word == "R" || word == "LR" || word == "uR" || word == "UR" || word == "u8R");
+            state = raw ? State::RawDelim : State::String;
+            raw_end  = ")\"";
+            raw_tail.clear();
+        } else if (c == '\'') {
+            // digit separator (1'000), not a char literal
+            if (word.empty() || !isdigit((unsigned char)word[0])) state = State::Char;
+        }
+
+        if (state == State::Code && (isalnum((unsigned char)c) || c == '_' || c == '\'' || (unsigned char)c >= 0x80)) word += c;
+        else word.clear();
+
+        last = c;
+        emit(c);
+    }
+
+    void end_directive() {
+        // '# <line>' and '#line' markers only say where code came from, #pragma etc. stay
+        size_t p = 1;
+        while (p < line.size() && isspace((unsigned char)line[p])) p++;
+        bool marker = (p < line.size() && isdigit((unsigned char)line[p])) || line.compare(p, 4, "line") == 0;
+
+        if (!marker) {
+            for (char c : line) code(c);
+            code('\n');
+        }
+        line.clear();
+    }
+
+public:
+    TokenNormalizer(Hasher& h) : hasher(h) {}
+
+    void feed(const char* data, usize size) {
+        for (usize i = 0; i < size; i++) {
+            char c = data[i];
+
+            if (in_directive) {
+                if (c == '\n') {
+                    in_directive  = false;
+                    at_line_start = true;
+                    end_directive();
+                } else {
+                    line += c;
+                }
+                continue;
+            }
+
+            // directives only start a line outside of literals
+            if (at_line_start && state == State::Code && c == '#') {
+                in_directive = true;
+                line = c;
+                continue;
+            }
+
+            if (c == '\n') at_line_start = true;
+            else if (!isspace((unsigned char)c)) at_line_start = false;
+
+            code(c);
+        }
+    }
+
+    void finish() {
+        if (in_directive) end_directive();
+        flush();
+    }
+};
+
+// helper -> run the preprocessor and hash its stdout as it streams through a pipe,
+// optionally copying it into tee_path and collecting linemarkers on the way
+static bool preprocess_and_hash(
+    const CompileCmd& cmd,
+    Hash128& hash,
+    bool normalize,
+    const string& tee_path = "",
+    LinemarkerScanner* scanner = nullptr
+) {
+    Hasher hasher;
+    TokenNormalizer normalizer(hasher);
+
+    // a normalized hash never equals a raw one. toggling the option rebuilds nothing by itself,
+    // the next TU that gets preprocessed compiles once (see README)
+    if (normalize) hasher.update_str("normalized");
+
+    std::ofstream tee;
+    if (!tee_path.empty()) {
+        tee.open(tee_path, std::ios::binary | std::ios::trunc);
+        if (!tee.is_open()) return false;
+    }
+
+    ProcessOptions opts;
+    opts.on_stdout = [&](const char* data, usize size) {
+        if (normalize) normalizer.feed(data, size);
+        else hasher.update(data, size);
+
+        if (tee.is_open()) tee.write(data, size);
+        if (scanner) scanner->feed(data, size);
+    };
+
+    if (!Process::run(cmd, opts).ok()) return false;
+    if (scanner) scanner->finish();
+    if (normalize) normalizer.finish();
+
+    hash = hasher.digest();
+    return !tee.is_open() || tee.good();
 }
 
 void Cache::load(const string &root) {
     cache_path = root + "/.ymake.cache";
-    if (!fs::exists(cache_path)) return;
 
-    std::ifstream in(cache_path);
-    string path;
-    size_t hash;
-    time_t time;
-    
-    // Read the path safely, even if it has spaces
-    while (in >> std::quoted(path) >> hash >> time) {
-        registry[path] = {hash, time};
+    // missing, older or foreign files just leave the base empty, next build re-checks everything
+    base.open(cache_path);
+    globs.load(root);
+
+    bool ok = journal.open(
+        root + "/.ymake.journal",
+        [&](const string& key, FileCache&& entry) {
+            registry[key] = std::move(entry);
+            erased.erase(key);
+        },
+        [&](const string& key) {
+            registry.erase(key);
+            erased.insert(key);
+        }
+    );
+
+    if (!ok) {
+        LOGFMT(PROJNAME, "cache", YELLOW_TEXT("[WARN]: "), "Cannot open ", root, "/.ymake.journal, cache updates won't persist\n");
     }
 }
 
 void Cache::save() {
-    std::ofstream out(cache_path);
-    for (const auto& [path, entry] : registry) {
-        // Write the path wrapped in quotes
-        out << std::quoted(path) << " " << entry.hash << " " << entry.timestamp << "\n";
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    globs.save();
+    remote.flush();
+    store.flush();
+
+    // every update already went through the journal, this only keeps it short
+    bool base_missing = base.file_size() == 0 && !journal.empty();
+    if (base_missing || journal.size() > std::max(MIN_COMPACT_SIZE, base.file_size() / 2)) {
+        compact();
     }
 }
 
-bool Cache::needs_recompile(const Project& proj, const Config& config, const string &src) {
+void Cache::compact() {
+    // base entries that survived, copied out before the mapping goes away
+    vector<std::pair<string, FileCache>> kept;
+    base.for_each([&](const string& key, const FileCache& entry) {
+        if (!registry.count(key) && !erased.count(key)) kept.emplace_back(key, entry);
+    });
+
+    vector<std::pair<string, const FileCache*>> entries;
+    entries.reserve(kept.size() + registry.size());
+    for (const auto& [key, entry] : kept) entries.emplace_back(key, &entry);
+    for (const auto& [key, entry] : registry) entries.emplace_back(key, &entry);
+
+    // unmap first, windows can't rename over a mapped file
+    base.close();
+    bool written = CacheFile::write(cache_path, entries);
+    base.open(cache_path);
+
+    if (!written) {
+        // the journal still has everything, try again next save
+        LOGFMT(PROJNAME, "cache", RED_TEXT("[ERROR]: "), "Failed to write ", cache_path, "\n");
+        return;
+    }
+
+    registry.clear();
+    erased.clear();
+    journal.reset();
+}
+
+bool Cache::lookup(const string &obj, FileCache &out) const {
+    auto it = registry.find(obj);
+    if (it != registry.end()) {
+        out = it->second;
+        return true;
+    }
+
+    if (erased.count(obj)) return false;
+    return base.find(obj, out);
+}
+
+// a stamp that could be from after started_ns says nothing about what the compiler read
+static FileStamp settled(FileStamp stamp, u64 started_ns) {
+    if (stamp.mtime_ns + Cache::RACY_NS > started_ns) return {};
+    return stamp;
+}
+
+Hash128 Cache::content_hash(const string &path, const FileStamp &stamp, u64 before_ns) {
+    if (!stamp.exists || settled(stamp, before_ns) != stamp) return {};
+    {
+        std::lock_guard<std::mutex> lock(contents_mutex);
+        auto it = contents.find(path);
+        if (it != contents.end() && it->second.stamp == stamp) return it->second.hash;
+    }
+
+    // the snapshot's stamp may be from before the file was saved again, ask the disk
+    Hash128 hash;
+    if (!hash_file(path, hash) || FileStat::get(path) != stamp) return {};
+
+    std::lock_guard<std::mutex> lock(contents_mutex);
+    contents[path] = {stamp, hash};
+    return hash;
+}
+
+bool Cache::needs_recompile(const Project& proj, const Config& config, const CompileTemplate& tmpl, const string &src, const string &obj, string *preprocessed) {
+    // preprocessor writes to stdout, we read it through a pipe
+    // (a long one reads its flags from a response file next to the object)
+    CompileCmd cmd = Toolchain::with_response_file(
+        tmpl.type, Toolchain::create_preprocess_cmd(tmpl, src, ""), fs::path(obj).parent_path().string()
+    );
+
+    // the full compile argv, so code generation flags (-O3, -march...) count too,
+    // not only the ones that change the preprocessed text. always the plain
+    // form, compiling from the -P output is the same compile
+    FileCache entry;
+    entry.stamp    = FsSnapshot::stat(src);
+    entry.cmd_hash = hash_command(Toolchain::create_compile_cmd(tmpl, src, obj));
+
+    FileStamp obj_stamp = FsSnapshot::stat(obj);
+    bool obj_exists     = obj_stamp.exists;
+
     // check if file exists in cache
-    bool is_new = registry.find(src) == registry.end();
-    
-    // NOTE: add timestamp optimization later if building is too slow
+    FileCache cached;
+    bool is_new;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        is_new = !lookup(obj, cached);
+    }
+
+    // ----- fast path: nothing we depend on moved since last time, pure stat calls
+    // (an unknown stamp, see commit, is equal to a missing file's but never counts as a match)
+    if (!is_new && obj_exists && cached.cmd_hash == entry.cmd_hash && cached.stamp.exists && cached.stamp == entry.stamp) {
+        bool deps_unchanged = true;
+        for (const auto& dep : cached.deps) {
+            if (!dep.stamp.exists || FsSnapshot::stat(dep.path) != dep.stamp) {
+                deps_unchanged = false;
+                break;
+            }
+        }
 
-    // ----- preprocessing (temporary file)
-    string temp_i = "build/temp.i"; 
-    fs::create_directories("build"); // just in case
+        if (deps_unchanged) return false;
+    }
+
+    // ----- touched, not edited (saved again, checked out, copied over): the stamps moved
+    // but every moved file still has the content it was compiled from -> new stamps, no compile
+    if (!is_new && obj_exists && cached.cmd_hash == entry.cmd_hash && !cached.src_hash.empty()) {
+        auto same = [](const string& path, const FileStamp& now, const FileStamp& was, const Hash128& hash) {
+            if (was.exists && now == was) return true;
+
+            Hash128 current;
+            return now.exists && !hash.empty() && hash_file(path, current) && current == hash;
+        };
+
+        bool unchanged = same(src, entry.stamp, cached.stamp, cached.src_hash);
+        vector<DepStamp> deps;
+        for (size_t i = 0; unchanged && i < cached.deps.size(); i++) {
+            const DepStamp& dep = cached.deps[i];
+            FileStamp stamp = FsSnapshot::stat(dep.path);
+            unchanged = same(dep.path, stamp, dep.stamp, dep.hash);
+            deps.push_back({dep.path, stamp, dep.hash});
+        }
+
+        if (unchanged) {
+            // a fresh stamp is recorded as unknown, same as in commit, the hashes settle it next time
+            u64 now = FileStat::now_ns();
+            entry.hash     = cached.hash;
+            entry.src_hash = cached.src_hash;
+            entry.stamp    = settled(entry.stamp, now);
+            for (auto& dep : deps) dep.stamp = settled(dep.stamp, now);
+            entry.deps = std::move(deps);
+
+            update(obj, std::move(entry));
+            return false;
+        }
+    }
+
+    // ----- no record, but an object from an earlier build (ex: the cache was deleted).
+    // its directory already pins the config (see Builder::get_obj_dir), so it's good
+    // if it's newer than the source and every header the scanner finds, make-style
+    if (is_new && obj_exists && entry.stamp.exists) {
+        vector<string> headers;
+        bool newer = include_scanner.scan(src, IncludeScanner::search_dirs(config), headers) &&
+                     entry.stamp.mtime_ns <= obj_stamp.mtime_ns;
+
+        for (size_t i = 0; newer && i < headers.size(); i++) {
+            FileStamp stamp = FsSnapshot::stat(headers[i]);
+            newer = stamp.exists && stamp.mtime_ns <= obj_stamp.mtime_ns;
+            entry.deps.push_back({std::move(headers[i]), stamp});
+        }
+
+        // hashed as the object saw them (older than it), so touching one doesn't compile it.
+        // no preprocessed hash yet, the next real edit compiles without preprocessing first
+        if (newer) {
+            entry.src_hash = content_hash(src, entry.stamp, obj_stamp.mtime_ns);
+            for (auto& dep : entry.deps) dep.hash = content_hash(dep.path, dep.stamp, obj_stamp.mtime_ns);
+            update(obj, std::move(entry));
+            return false;
+        }
+        entry.deps.clear();
+    }
 
-    CompileCmd cmd = Toolchain::create_preprocess_cmd(proj, config, src, temp_i);
-    
-    string content = run_and_read(cmd, temp_i);
-    if (content.empty()) return true;
+    // nothing to compare against (or the command changed) -> compile, the depfile fills in the headers.
+    // with a store the TU is preprocessed anyway, another workspace may have compiled it already
+    bool comparable = !is_new && obj_exists && cached.cmd_hash == entry.cmd_hash;
 
-    // hash content of file
-    size_t current_hash = std::hash<std::string>{}(content);
+    // read before compiling, commit drops it again if the source changes on the way
+    u64 checked    = FileStat::now_ns();
+    entry.src_hash = content_hash(src, entry.stamp, checked);
 
-    // compare
-    if (is_new) {
-        update(src, current_hash); // update cache
+    if (!comparable && !sharing()) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        pending[obj] = std::move(entry);
         return true;
     }
 
-    if (registry[src].hash != current_hash) {
-        update(src, current_hash);
+    // ----- slow path: something was touched, let the preprocessor decide
+    // -P keeps the output for the compile step, its linemarkers stand in for the depfile
+    string kept_i = keep_preprocessed ? obj + ".i" : "";
+    LinemarkerScanner scanner(src);
+
+    auto drop_kept = [&] {
+        if (kept_i.empty()) return;
+        std::error_code ec;
+        fs::remove(kept_i, ec);
+    };
+
+    Hash128 hash;
+    bool scan = keep_preprocessed || sharing();
+    if (!preprocess_and_hash(cmd, hash, normalize, kept_i, scan ? &scanner : nullptr)) {
+        drop_kept();
         return true;
     }
 
-    // if all checks fail, that means it's up to date
+    entry.hash = hash; // hash content of file
+
+    // same output (ex: a comment edit with -N, or a touch before anything was hashed)
+    // -> refresh stamps, skip compile
+    if (comparable && entry.hash == cached.hash) {
+        for (const auto& dep : cached.deps) {
+            FileStamp stamp = FsSnapshot::stat(dep.path);
+            Hash128 hash    = content_hash(dep.path, stamp, checked);
+            entry.deps.push_back({dep.path, settled(stamp, checked), hash});
+        }
+        entry.stamp = settled(entry.stamp, checked);
+        update(obj, std::move(entry));
+        drop_kept();
+        return false;
+    }
+
+    // ----- the store (or the remote) has it: place the object, the linemarkers give the headers
+    Hash128 key = sharing() ? store_key(proj, config, entry.hash) : Hash128{};
+    if (!key.empty() && fetch_shared("obj", key, obj)) {
+        FsSnapshot::invalidate(obj);
+        for (const auto& dep : scanner.deps) {
+            FileStamp stamp = FsSnapshot::stat(dep);
+            entry.deps.push_back({dep, stamp, content_hash(dep, stamp, checked)});
+        }
+        update(obj, std::move(entry));
+        drop_kept();
+        return false;
+    }
+
+    // the compile step reuses this output
+    if (keep_preprocessed) {
+        for (auto& dep : scanner.deps) {
+            entry.deps.push_back({std::move(dep), {}});
+        }
+        if (preprocessed) *preprocessed = kept_i;
+    }
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    pending[obj] = std::move(entry);
+    if (!key.empty()) store_keys[obj] = key;
+    return true;
+}
+
+// placeholders instead of the TU's paths, so another worktree or object directory
+// runs the same command. debug info records the working directory, then it's
+// part of the key too (what ccache calls hash_dir), unless the root is remapped.
+// only stale TUs get here, so the template with the placeholder root is built per call
+Hash128 Cache::store_key(const Project& proj, const Config& config, const Hash128& input_hash) {
+    Config keyed = config;
+    if (keyed.path_root.has_value()) keyed.path_root = "<root>";
+
+    CompileTemplate tmpl = Toolchain::create_compile_template(proj, keyed);
+    CompileCmd cmd       = Toolchain::create_compile_cmd(tmpl, "<src>", "<obj>");
+    bool remapped        = config.path_root.has_value() && tmpl.type != CompilerType::MSVC;
+
+    bool debug_info = false, shared_pdb = false;
+    cmd.for_each_arg([&](const string& arg) {
+        // msvc's /Zi writes one .pdb shared by every object, there's nothing to store
+        if (arg == "/Zi" || arg == "/ZI" || arg == "-Zi" || arg == "-ZI") shared_pdb = true;
+        if (arg.compare(0, 2, "-g") == 0 || arg == "/Z7" || arg == "-Z7") debug_info = true;
+    });
+    if (shared_pdb) return {};
+
+    Hasher hasher;
+    ObjectStore::hash_compile(hasher, cmd);
+    if (debug_info && !remapped) hasher.update_str(fs::current_path().string());
+    hasher.update_u64(input_hash.hi);
+    hasher.update_u64(input_hash.lo);
+    return hasher.digest();
+}
+
+void Cache::collect_inputs(const string &obj, vector<string> &out) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    FileCache cached;
+    if (!lookup(obj, cached)) return;
+    for (auto& dep : cached.deps) out.push_back(std::move(dep.path));
+}
+
+void Cache::update(const string &obj, FileCache entry) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    erased.erase(obj);
+    journal.put(obj, entry);
+    registry[obj] = std::move(entry);
+
+    if (journal.size() > MAX_JOURNAL_SIZE) compact();
+}
+
+void Cache::commit(const string &obj, const vector<string> &deps, u64 started_ns) {
+    // stat outside the lock, compile jobs finish concurrently
+    vector<DepStamp> stamps;
+    stamps.reserve(deps.size());
+    for (const auto& dep : deps) {
+        FileStamp stamp = FsSnapshot::stat(dep);
+        Hash128 hash    = content_hash(dep, stamp, started_ns);
+        stamps.push_back({dep, settled(stamp, started_ns), hash});
+    }
+
+    Hash128 key;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto it = pending.find(obj);
+        if (it == pending.end()) return;
+
+        it->second.deps  = std::move(stamps);
+        it->second.stamp = settled(it->second.stamp, started_ns); // saved during the check, right before
+        if (!it->second.stamp.exists) it->second.src_hash = {};
+        journal.put(obj, it->second);
+        erased.erase(obj);
+        registry[obj] = std::move(it->second);
+        pending.erase(it);
+
+        auto stored = store_keys.find(obj);
+        if (stored != store_keys.end()) {
+            key = stored->second;
+            store_keys.erase(stored);
+        }
+
+        if (journal.size() > MAX_JOURNAL_SIZE) compact();
+    }
+
+    // copying the object shouldn't hold up the other workers
+    if (!key.empty()) share("obj", key, obj);
+}
+
+void Cache::commit(const string &obj, u64 started_ns) {
+    vector<string> deps;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto it = pending.find(obj);
+        if (it == pending.end()) return;
+
+        for (const auto& dep : it->second.deps) deps.push_back(dep.path);
+    }
+
+    commit(obj, deps, started_ns);
+}
+
+void Cache::invalidate(const string &obj) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.erase(obj);
+    pending.erase(obj);
+    store_keys.erase(obj);
+    erased.insert(obj);
+    journal.erase(obj);
+}
+
+void Cache::invalidate_dir(const string &dir) {
+    string prefix = dir + "/";
+    auto inside = [&](const string& key) { return key.compare(0, prefix.size(), prefix) == 0; };
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    vector<string> keys;
+    base.for_each([&](const string& key, const FileCache&) {
+        if (inside(key) && !erased.count(key)) keys.push_back(key);
+    });
+    for (const auto& [key, _] : registry) {
+        if (inside(key)) keys.push_back(key);
+    }
+
+    for (const auto& key : keys) {
+        if (erased.count(key)) continue; // in both base and registry
+        registry.erase(key);
+        pending.erase(key);
+        store_keys.erase(key);
+        erased.insert(key);
+        journal.erase(key);
+    }
+}
+
+// ----- link steps
+static string link_key(const string& out) {
+    return "link:" + out;
+}
+
+static Hash128 hash_inputs(const vector<string>& inputs) {
+    Hasher h;
+    h.update_u64(inputs.size());
+    for (const auto& input : inputs) h.update_str(input);
+    return h.digest();
+}
+
+bool Cache::needs_relink(const CompileCmd &cmd, const string &out, const vector<string> &inputs) {
+    FileCache cached;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (!lookup(link_key(out), cached)) return true;
+    }
+
+    // output deleted or replaced behind our back
+    FileStamp out_stamp = FsSnapshot::stat(out);
+    if (!out_stamp.exists || out_stamp != cached.stamp) return true;
+
+    // objects added/removed, flags or libraries changed
+    if (cached.cmd_hash != hash_command(cmd) || cached.hash != hash_inputs(inputs)) return true;
+
+    // restat: a rebuilt input with the same bytes (ex: comment-only header edit)
+    // doesn't relink, and so doesn't touch the output our dependents check
+    bool restamped = false;
+    for (auto& dep : cached.deps) {
+        FileStamp now = FsSnapshot::stat(dep.path);
+        if (now == dep.stamp) continue;
+
+        Hash128 hash;
+        if (!now.exists || dep.hash.empty() || !hash_file(dep.path, hash) || hash != dep.hash) return true;
+
+        dep.stamp = now;
+        restamped = true;
+    }
+
+    // same content, new stamps -> next build is stat-only again
+    if (restamped) update(link_key(out), std::move(cached));
     return false;
 }
 
-void Cache::update(const string &src, size_t h) {
+void Cache::commit_link(const CompileCmd &cmd, const string &out, const vector<string> &inputs) {
+    // inputs whose stamp didn't move keep their hash, only rebuilt ones are read
+    FileCache previous;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        lookup(link_key(out), previous);
+    }
+
+    unordered_map<string, const DepStamp*> known;
+    for (const auto& dep : previous.deps) known[dep.path] = &dep;
+
+    FileCache entry;
+    entry.hash     = hash_inputs(inputs);
+    entry.cmd_hash = hash_command(cmd);
+    entry.stamp    = FsSnapshot::stat(out);
+
+    entry.deps.reserve(inputs.size());
+    for (const auto& input : inputs) {
+        DepStamp dep{input, FsSnapshot::stat(input), {}};
+
+        auto it = known.find(input);
+        if (it != known.end() && it->second->stamp == dep.stamp) dep.hash = it->second->hash;
+        else hash_file(input, dep.hash); // unreadable -> empty, always relinks
+
+        entry.deps.push_back(std::move(dep));
+    }
+
+    update(link_key(out), std::move(entry));
+}
+
+void Cache::invalidate_link(const string &out) {
+    invalidate(link_key(out));
+}
+
+// ----- shared outputs
+Hash128 Cache::shared_link_key(const CompileCmd &cmd, const vector<string> &inputs) {
+    if (!sharing()) return {};
+
+    Hasher hasher;
+    ObjectStore::hash_compile(hasher, cmd);
+    for (const auto& input : inputs) {
+        Hash128 hash;
+        if (!hash_file(input, hash)) return {};
+        hasher.update_u64(hash.hi);
+        hasher.update_u64(hash.lo);
+    }
+    return hasher.digest();
+}
+
+bool Cache::fetch_shared(const char *kind, const Hash128 &key, const string &path) {
+    if (store.enabled() && store.fetch(key, path)) return true;
+    if (!remote.enabled() || !remote.fetch(kind, key, path)) return false;
+
+    if (store.enabled()) store.put(key, path);
+    return true;
+}
 
-    // update the hash DSA, write to disk one time only
-    registry[src].hash = h;
-    registry[src].timestamp = 0; // NOTE: add real timestamp if we want to use that logic
+void Cache::share(const char *kind, const Hash128 &key, const string &path) {
+    if (store.enabled()) store.put(key, path);
+    if (remote.enabled()) remote.put(kind, key, path);
 }
 
-} // namespace ymk::build
\ No newline at end of file
+} // namespace ymk::build
@@ -0,0 +1,618 @@
+#include <build/cache_file.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#ifndef IPLATFORM_WINDOWS
+    #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace ymk::build
+{
+
+// ----- on-disk layout (little endian, offsets from the start of the file)
+static const char CACHE_MAGIC[8]   = {'Y', 'M', 'K', 'C', 'A', 'C', 'H', 'E'};
+static const char JOURNAL_MAGIC[8] = {'Y', 'M', 'K', 'J', 'R', 'N', 'L', '\0'};
+static const char GLOBS_MAGIC[8]   = {'Y', 'M', 'K', 'G', 'L', 'O', 'B', 'S'};
+
+static constexpr usize HEADER_SIZE  = 64;
+static constexpr usize ENTRY_SIZE   = 112;
+static constexpr usize DEP_SIZE     = 56;
+static constexpr usize JOURNAL_HEAD = 16;
+
+//  header: magic[8] version:u32 entry_count:u32 entries:u64 deps:u64 deps_count:u64
+//          strings:u64 strings_size:u64 reserved:u64
+//  entry:  key_hi key_lo key_off:u32 key_len:u32 hash_hi hash_lo cmd_hi cmd_lo src_hi src_lo
+//          mtime size inode deps_begin:u32 deps_count:u32 flags:u32 pad:u32
+//  dep:    path_off:u32 path_len:u32 mtime size inode hash_hi hash_lo flags:u32 pad:u32
+
+enum : u32 {
+    FLAG_EXISTS = 1 << 0,
+    FLAG_DIR    = 1 << 1,
+    FLAG_FILE   = 1 << 2,
+};
+
+enum : u32 {
+    RECORD_PUT   = 1,
+    RECORD_ERASE = 2,
+};
+
+// ----- byte helpers
+static inline u32 get_u32(const unsigned char* p) { u32 v; memcpy(&v, p, 4); return v; }
+static inline u64 get_u64(const unsigned char* p) { u64 v; memcpy(&v, p, 8); return v; }
+
+static inline void put_u32(string& out, u32 v) { out.append((const char*)&v, 4); }
+static inline void put_u64(string& out, u64 v) { out.append((const char*)&v, 8); }
+
+static inline void put_hash(string& out, const Hash128& h) {
+    put_u64(out, h.hi);
+    put_u64(out, h.lo);
+}
+
+static inline void put_stamp(string& out, const FileStamp& s) {
+    put_u64(out, s.mtime_ns);
+    put_u64(out, s.size);
+    put_u64(out, s.inode);
+}
+
+static inline FileStamp get_stamp(const unsigned char* p, u32 flags) {
+    FileStamp s;
+    s.mtime_ns = get_u64(p);
+    s.size     = get_u64(p + 8);
+    s.inode    = get_u64(p + 16);
+    s.exists   = flags & FLAG_EXISTS;
+    return s;
+}
+
+// bounds-checked reader for journal payloads
+struct ByteReader {
+    const unsigned char* p;
+    const unsigned char* end;
+
+    bool u32_(u32& v) { if (end - p < 4) return false; v = get_u32(p); p += 4; return true; }
+    bool u64_(u64& v) { if (end - p < 8) return false; v = get_u64(p); p += 8; return true; }
+
+    bool str(string& s) {
+        u32 len;
+        if (!u32_(len) || (usize)(end - p) < len) return false;
+        s.assign((const char*)p, len);
+        p += len;
+        return true;
+    }
+
+    bool hash(Hash128& h) { return u64_(h.hi) && u64_(h.lo); }
+
+    bool stamp(FileStamp& s) {
+        u32 flags;
+        if (!u64_(s.mtime_ns) || !u64_(s.size) || !u64_(s.inode) || !u32_(flags)) return false;
+        s.exists = flags & FLAG_EXISTS;
+        return true;
+    }
+};
+
+static void encode_entry(string& out, const string& key, const FileCache& entry) {
+    put_u32(out, (u32)key.size());
+    out += key;
+    put_hash(out, entry.hash);
+    put_hash(out, entry.cmd_hash);
+    put_hash(out, entry.src_hash);
+    put_stamp(out, entry.stamp);
+    put_u32(out, entry.stamp.exists ? u32(FLAG_EXISTS) : 0u);
+
+    put_u32(out, (u32)entry.deps.size());
+    for (const auto& dep : entry.deps) {
+        put_u32(out, (u32)dep.path.size());
+        out += dep.path;
+        put_stamp(out, dep.stamp);
+        put_u32(out, dep.stamp.exists ? u32(FLAG_EXISTS) : 0u);
+        put_hash(out, dep.hash);
+    }
+}
+
+static bool decode_entry(ByteReader& in, string& key, FileCache& entry) {
+    u32 dep_count;
+    if (!in.str(key) || !in.hash(entry.hash) || !in.hash(entry.cmd_hash) ||
+        !in.hash(entry.src_hash) || !in.stamp(entry.stamp) || !in.u32_(dep_count)) {
+        return false;
+    }
+
+    // each dep takes at least 48 bytes, refuse counts the payload can't hold
+    if ((usize)(in.end - in.p) / 48 < dep_count) return false;
+
+    entry.deps.resize(dep_count);
+    for (auto& dep : entry.deps) {
+        if (!in.str(dep.path) || !in.stamp(dep.stamp) || !in.hash(dep.hash)) return false;
+    }
+    return true;
+}
+
+// writes path + ".tmp" and renames it over path
+static bool write_replace(const string& path, std::initializer_list<const string*> parts) {
+    string tmp = path + ".tmp";
+    FILE* out = fopen(tmp.c_str(), "wb");
+    if (!out) return false;
+
+    bool ok = true;
+    for (const string* part : parts) {
+        if (ok) ok = fwrite(part->data(), 1, part->size(), out) == part->size();
+    }
+    if (ok) ok = fflush(out) == 0;
+
+#ifndef IPLATFORM_WINDOWS
+    // the rename must not land before the data does
+    if (ok) ok = fsync(fileno(out)) == 0;
+#endif
+    fclose(out);
+
+    std::error_code ec;
+    if (ok) fs::rename(tmp, path, ec);
+    if (!ok || ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+// ----- CacheFile
+bool CacheFile::open(const string& path) {
+    close();
+    if (!file.open(path)) return false;
+
+    const unsigned char* base = file.data();
+    usize size = file.size();
+
+    if (size < HEADER_SIZE || memcmp(base, CACHE_MAGIC, 8) != 0 || get_u32(base + 8) != VERSION) {
+        close();
+        return false;
+    }
+
+    u32 count       = get_u32(base + 12);
+    u64 entries_off = get_u64(base + 16);
+    u64 deps_off    = get_u64(base + 24);
+    u64 dep_count   = get_u64(base + 32);
+    u64 strings_off = get_u64(base + 40);
+    u64 str_size    = get_u64(base + 48);
+
+    // only the section bounds are validated, records are decoded on lookup
+    bool in_bounds =
+        entries_off <= size && (size - entries_off) / ENTRY_SIZE >= count &&
+        deps_off <= size && (size - deps_off) / DEP_SIZE >= dep_count &&
+        strings_off <= size && size - strings_off >= str_size;
+
+    if (!in_bounds) {
+        close();
+        return false;
+    }
+
+    entry_count  = count;
+    entries      = base + entries_off;
+    deps         = base + deps_off;
+    deps_count   = dep_count;
+    strings      = base + strings_off;
+    strings_size = str_size;
+    return true;
+}
+
+void CacheFile::close() {
+    file.close();
+    entry_count  = 0;
+    entries      = nullptr;
+    deps         = nullptr;
+    strings      = nullptr;
+    deps_count   = 0;
+    strings_size = 0;
+}
+
+bool CacheFile::read_string(u32 offset, u32 length, string& out) const {
+    if ((u64)offset + length > strings_size) return false;
+    out.assign((const char*)strings + offset, length);
+    return true;
+}
+
+bool CacheFile::read_entry(u32 index, string* key, FileCache* entry) const {
+    const unsigned char* rec = entries + (usize)index * ENTRY_SIZE;
+
+    if (key && !read_string(get_u32(rec + 16), get_u32(rec + 20), *key)) return false;
+    if (!entry) return true;
+
+    entry->hash.hi     = get_u64(rec + 24);
+    entry->hash.lo     = get_u64(rec + 32);
+    entry->cmd_hash.hi = get_u64(rec + 40);
+    entry->cmd_hash.lo = get_u64(rec + 48);
+    entry->src_hash.hi = get_u64(rec + 56);
+    entry->src_hash.lo = get_u64(rec + 64);
+    entry->stamp       = get_stamp(rec + 72, get_u32(rec + 104));
+
+    u32 begin = get_u32(rec + 96);
+    u32 count = get_u32(rec + 100);
+    if ((u64)begin + count > deps_count) return false;
+
+    entry->deps.resize(count);
+    for (u32 i = 0; i < count; i++) {
+        const unsigned char* dep = deps + (usize)(begin + i) * DEP_SIZE;
+        if (!read_string(get_u32(dep), get_u32(dep + 4), entry->deps[i].path)) return false;
+        entry->deps[i].stamp   = get_stamp(dep + 8, get_u32(dep + 48));
+        entry->deps[i].hash.hi = get_u64(dep + 32);
+        entry->deps[i].hash.lo = get_u64(dep + 40);
+    }
+    return true;
+}
+
+bool CacheFile::find(const string& key, FileCache& out) const {
+    if (!entries) return false;
+
+    Hash128 h = Hasher::of(key);
+    auto key_at = [&](u32 i) {
+        const unsigned char* rec = entries + (usize)i * ENTRY_SIZE;
+        return std::make_pair(get_u64(rec), get_u64(rec + 8));
+    };
+
+    // lower bound on (hi, lo)
+    u32 lo = 0, hi = entry_count;
+    while (lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (key_at(mid) < std::make_pair(h.hi, h.lo)) lo = mid + 1;
+        else hi = mid;
+    }
+
+    // equal hashes are neighbours, the key string settles it
+    string found;
+    for (; lo < entry_count && key_at(lo) == std::make_pair(h.hi, h.lo); lo++) {
+        if (read_string(get_u32(entries + (usize)lo * ENTRY_SIZE + 16),
+                        get_u32(entries + (usize)lo * ENTRY_SIZE + 20), found) &&
+            found == key) {
+            return read_entry(lo, nullptr, &out);
+        }
+    }
+    return false;
+}
+
+void CacheFile::for_each(const std::function<void(const string&, const FileCache&)>& fn) const {
+    string key;
+    FileCache entry;
+    for (u32 i = 0; i < entry_count; i++) {
+        if (read_entry(i, &key, &entry)) fn(key, entry);
+    }
+}
+
+bool CacheFile::write(const string& path, const vector<std::pair<string, const FileCache*>>& input) {
+    // sort by key hash, the order find() binary searches in
+    struct Item {
+        Hash128 key_hash;
+        const string* key;
+        const FileCache* entry;
+    };
+
+    vector<Item> items;
+    items.reserve(input.size());
+    for (const auto& [key, entry] : input) {
+        items.push_back({Hasher::of(key), &key, entry});
+    }
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+        return std::make_pair(a.key_hash.hi, a.key_hash.lo) < std::make_pair(b.key_hash.hi, b.key_hash.lo);
+    });
+
+    // strings are shared (every TU lists the same headers), store each once
+    string blob;
+    std::unordered_map<string, u32> interned;
+    auto intern = [&](const string& s) {
+        auto it = interned.find(s);
+        if (it != interned.end()) return it->second;
+
+        u32 off = (u32)blob.size();
+        blob += s;
+        interned.emplace(s, off);
+        return off;
+    };
+
+    string entry_sec, dep_sec;
+    entry_sec.reserve(items.size() * ENTRY_SIZE);
+    u32 dep_index = 0;
+
+    for (const auto& item : items) {
+        const FileCache& e = *item.entry;
+
+        put_hash(entry_sec, item.key_hash);
+        put_u32(entry_sec, intern(*item.key));
+        put_u32(entry_sec, (u32)item.key->size());
+        put_hash(entry_sec, e.hash);
+        put_hash(entry_sec, e.cmd_hash);
+        put_hash(entry_sec, e.src_hash);
+        put_stamp(entry_sec, e.stamp);
+        put_u32(entry_sec, dep_index);
+        put_u32(entry_sec, (u32)e.deps.size());
+        put_u32(entry_sec, e.stamp.exists ? u32(FLAG_EXISTS) : 0u);
+        put_u32(entry_sec, 0);
+
+        for (const auto& dep : e.deps) {
+            put_u32(dep_sec, intern(dep.path));
+            put_u32(dep_sec, (u32)dep.path.size());
+            put_stamp(dep_sec, dep.stamp);
+            put_hash(dep_sec, dep.hash);
+            put_u32(dep_sec, dep.stamp.exists ? u32(FLAG_EXISTS) : 0u);
+            put_u32(dep_sec, 0);
+        }
+        dep_index += (u32)e.deps.size();
+    }
+
+    string header(CACHE_MAGIC, 8);
+    put_u32(header, VERSION);
+    put_u32(header, (u32)items.size());
+    put_u64(header, HEADER_SIZE);
+    put_u64(header, HEADER_SIZE + entry_sec.size());
+    put_u64(header, dep_index);
+    put_u64(header, HEADER_SIZE + entry_sec.size() + dep_sec.size());
+    put_u64(header, blob.size());
+    put_u64(header, 0);
+
+    return write_replace(path, {&header, &entry_sec, &dep_sec, &blob});
+}
+
+// ----- CacheJournal
+//  file:   magic[8] version:u32 pad:u32 { record }
+//  record: type:u32 payload_len:u32 payload checksum:u64 (hash of type + payload)
+
+static u64 record_checksum(u32 type, const unsigned char* payload, usize size) {
+    Hasher h;
+    h.update(&type, sizeof(type));
+    h.update(payload, size);
+    return h.digest().lo;
+}
+
+bool CacheJournal::open(
+    const string& journal_path,
+    const std::function<void(const string&, FileCache&&)>& on_put,
+    const std::function<void(const string&)>& on_erase
+) {
+    close();
+    path = journal_path;
+
+    // the journal is bounded by compaction, reading it whole is fine
+    string data;
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (in.is_open()) data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    const unsigned char* base = (const unsigned char*)data.data();
+    bool valid = data.size() >= JOURNAL_HEAD && memcmp(base, JOURNAL_MAGIC, 8) == 0 &&
+                 get_u32(base + 8) == CacheFile::VERSION;
+
+    usize good_end = 0;
+    if (valid) {
+        usize pos = JOURNAL_HEAD;
+        good_end  = pos;
+
+        while (data.size() - pos >= 8) {
+            u32 type = get_u32(base + pos);
+            u32 len  = get_u32(base + pos + 4);
+            if (data.size() - pos - 8 < (usize)len + 8) break; // torn tail
+
+            const unsigned char* payload = base + pos + 8;
+            if (get_u64(payload + len) != record_checksum(type, payload, len)) break;
+
+            ByteReader in{payload, payload + len};
+            string key;
+            if (type == RECORD_PUT) {
+                FileCache entry;
+                if (!decode_entry(in, key, entry)) break;
+                on_put(key, std::move(entry));
+            } else if (type == RECORD_ERASE) {
+                if (!in.str(key)) break;
+                on_erase(key);
+            } else {
+                break;
+            }
+
+            pos += 8 + len + 8;
+            good_end = pos;
+            records++;
+        }
+    }
+
+    if (!valid) return reset();
+
+    // cut off whatever a crash left half-written, appends go after the last good record
+    if (good_end != data.size()) {
+        std::error_code ec;
+        fs::resize_file(path, good_end, ec);
+        if (ec) return reset();
+    }
+
+    out   = fopen(path.c_str(), "ab");
+    bytes = good_end;
+    return out != nullptr;
+}
+
+void CacheJournal::close() {
+    if (out) fclose(out);
+    out = nullptr;
+}
+
+bool CacheJournal::append(u32 type, const string& payload) {
+    if (!out) return false;
+
+    string record;
+    record.reserve(payload.size() + 16);
+    put_u32(record, type);
+    put_u32(record, (u32)payload.size());
+    record += payload;
+    put_u64(record, record_checksum(type, (const unsigned char*)payload.data(), payload.size()));
+
+    // one write per record + flush, a kill mid-build keeps everything before it
+    bool ok = fwrite(record.data(), 1, record.size(), out) == record.size() && fflush(out) == 0;
+    if (ok) {
+        bytes += record.size();
+        records++;
+    }
+    return ok;
+}
+
+bool CacheJournal::put(const string& key, const FileCache& entry) {
+    string payload;
+    encode_entry(payload, key, entry);
+    return append(RECORD_PUT, payload);
+}
+
+bool CacheJournal::erase(const string& key) {
+    string payload;
+    put_u32(payload, (u32)key.size());
+    payload += key;
+    return append(RECORD_ERASE, payload);
+}
+
+bool CacheJournal::reset() {
+    close();
+
+    out = fopen(path.c_str(), "wb");
+    if (!out) return false;
+
+    string header(JOURNAL_MAGIC, 8);
+    put_u32(header, CacheFile::VERSION);
+    put_u32(header, 0);
+
+    bool ok = fwrite(header.data(), 1, header.size(), out) == header.size() && fflush(out) == 0;
+    bytes   = header.size();
+    records = 0;
+    return ok;
+}
+
+// ----- GlobFile
+//  header: magic[8] version:u32 dir_count:u32 glob_count:u32 pad:u32
+//  dir:    path stamp entry_count:u32 { name flags:u32 }
+//  glob:   key watched_count:u32 { path stamp } set_count:u32 { count:u32 { path } }
+//  (strings are len:u32 + bytes, stamps as in the journal)
+
+static void put_str(string& out, const string& s) {
+    put_u32(out, (u32)s.size());
+    out += s;
+}
+
+static void put_flagged_stamp(string& out, const FileStamp& stamp, u32 flags) {
+    put_stamp(out, stamp);
+    put_u32(out, flags | (stamp.exists ? u32(FLAG_EXISTS) : 0u));
+}
+
+bool GlobFile::read(const string& path, std::unordered_map<string, DirRecord>& dirs, vector<GlobRecord>& globs) {
+    dirs.clear();
+    globs.clear();
+
+    MappedFile file;
+    if (!file.open(path)) return false;
+
+    const unsigned char* base = file.data();
+    if (file.size() < 24 || memcmp(base, GLOBS_MAGIC, 8) != 0 || get_u32(base + 8) != VERSION) return false;
+
+    u32 dir_count  = get_u32(base + 12);
+    u32 glob_count = get_u32(base + 16);
+    ByteReader in{base + 24, base + file.size()};
+
+    // counts are checked against what's left (every item takes at least 4 bytes)
+    auto fits = [&](u32 count) { return (usize)(in.end - in.p) / 4 >= count; };
+
+    bool ok = fits(dir_count);
+    for (u32 d = 0; ok && d < dir_count; d++) {
+        string dir;
+        DirRecord rec;
+        u32 entry_count = 0;
+        ok = in.str(dir) && in.stamp(rec.stamp) && in.u32_(entry_count) && fits(entry_count);
+
+        auto entries = std::make_shared<vector<FsSnapshot::DirEntry>>();
+        entries->reserve(ok ? entry_count : 0);
+        for (u32 i = 0; ok && i < entry_count; i++) {
+            string name;
+            u32 flags = 0;
+            ok = in.str(name) && in.u32_(flags);
+            entries->push_back({std::move(name), (flags & FLAG_DIR) != 0, (flags & FLAG_FILE) != 0});
+        }
+
+        rec.entries = std::move(entries);
+        if (ok) dirs.emplace(std::move(dir), std::move(rec));
+    }
+
+    ok = ok && fits(glob_count);
+    for (u32 g = 0; ok && g < glob_count; g++) {
+        GlobRecord rec;
+        u32 watched_count = 0, set_count = 0;
+        ok = in.hash(rec.key) && in.u32_(watched_count) && fits(watched_count);
+
+        rec.watched.resize(ok ? watched_count : 0);
+        for (auto& w : rec.watched) {
+            if (!ok) break;
+
+            u32 flags = 0;
+            ok = in.str(w.path) && in.u64_(w.stamp.mtime_ns) && in.u64_(w.stamp.size) &&
+                 in.u64_(w.stamp.inode) && in.u32_(flags);
+            w.stamp.exists = flags & FLAG_EXISTS;
+            w.is_dir       = flags & FLAG_DIR;
+        }
+
+        ok = ok && in.u32_(set_count) && fits(set_count);
+        rec.results.resize(ok ? set_count : 0);
+        for (auto& set : rec.results) {
+            u32 count = 0;
+            ok = ok && in.u32_(count) && fits(count);
+            if (!ok) break;
+
+            set.resize(count);
+            for (auto& result : set) {
+                if (!(ok = in.str(result))) break;
+            }
+        }
+
+        if (ok) globs.push_back(std::move(rec));
+    }
+
+    if (!ok) {
+        dirs.clear();
+        globs.clear();
+    }
+    return ok;
+}
+
+bool GlobFile::write(const string& path, const std::unordered_map<string, DirRecord>& dirs, const vector<GlobRecord>& globs) {
+    string header(GLOBS_MAGIC, 8);
+    put_u32(header, VERSION);
+    put_u32(header, (u32)dirs.size());
+    put_u32(header, (u32)globs.size());
+    put_u32(header, 0);
+
+    string body;
+    for (const auto& [dir, rec] : dirs) {
+        put_str(body, dir);
+        put_flagged_stamp(body, rec.stamp, FLAG_DIR);
+
+        put_u32(body, rec.entries ? (u32)rec.entries->size() : 0);
+        if (!rec.entries) continue;
+
+        for (const auto& entry : *rec.entries) {
+            put_str(body, entry.name);
+            put_u32(body, (entry.is_dir ? u32(FLAG_DIR) : 0u) | (entry.is_file ? u32(FLAG_FILE) : 0u));
+        }
+    }
+
+    for (const auto& rec : globs) {
+        put_hash(body, rec.key);
+
+        put_u32(body, (u32)rec.watched.size());
+        for (const auto& w : rec.watched) {
+            put_str(body, w.path);
+            put_flagged_stamp(body, w.stamp, w.is_dir ? u32(FLAG_DIR) : 0u);
+        }
+
+        put_u32(body, (u32)rec.results.size());
+        for (const auto& set : rec.results) {
+            put_u32(body, (u32)set.size());
+            for (const auto& result : set) put_str(body, result);
+        }
+    }
+
+    return write_replace(path, {&header, &body});
+}
+
+} // namespace ymk::build
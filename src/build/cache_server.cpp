@@ -0,0 +1,95 @@
+#include <build/cache_server.h>
+#include <build/hash.h>
+#include <core/http.h>
+#include <core/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace ymk::build
+{
+
+// "/obj/0123abcd..." -> "obj/0123abcd...", empty for anything that could leave dir
+static string safe_path(const string& path) {
+    if (path.size() < 2 || path[0] != '/') return "";
+
+    string rel = path.substr(1);
+    usize start = 0;
+    while (start <= rel.size()) {
+        usize end = rel.find('/', start);
+        if (end == string::npos) end = rel.size();
+
+        string segment = rel.substr(start, end - start);
+        if (segment.empty() || segment == "." || segment == "..") return "";
+        for (char c : segment) {
+            if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.') return "";
+        }
+        start = end + 1;
+    }
+    return rel;
+}
+
+bool CacheServer::run(const string& dir, const string& bind_address, u16 port, usize threads, u32 latency_ms) {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+        LOGFMT(PROJNAME, "cache-server", RED_TEXT("[ERROR]: "), "Cannot create ", dir, "\n");
+        return false;
+    }
+
+    std::atomic<u64> requests{0};
+
+    auto handler = [&](const string& method, const string& path, const string& body, string& response) -> i32 {
+        if (latency_ms) std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms));
+        requests++;
+
+        string rel = safe_path(path);
+        if (rel.empty()) return 400;
+        string file = dir + "/" + rel;
+
+        if (method == "GET" || method == "HEAD") {
+            std::ifstream in(file, std::ios::binary);
+            if (!in.is_open()) return 404;
+            response.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            return 200;
+        }
+
+        if (method == "PUT") {
+            std::error_code ec;
+            fs::create_directories(fs::path(file).parent_path(), ec);
+
+            // written aside and renamed in, a GET racing the PUT never sees half a blob
+            string tmp = file + "." + Hasher::of(path + std::to_string(FileStat::now_ns())).to_hex().substr(0, 8) + ".tmp";
+            {
+                std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+                out.write(body.data(), (std::streamsize)body.size());
+                if (!out.good()) return 500;
+            }
+
+            fs::rename(tmp, file, ec);
+            if (ec) {
+                fs::remove(tmp, ec);
+                return 500;
+            }
+            return 201;
+        }
+
+        return 405;
+    };
+
+    LOGFMT(PROJNAME, "cache-server", GREEN_TEXT("Serving "), fs::absolute(dir).string(), " on ", bind_address, ":", port, "\n");
+
+    if (!HttpServer::serve(bind_address, port, threads, handler)) {
+        LOGFMT(PROJNAME, "cache-server", RED_TEXT("[ERROR]: "), "Cannot listen on ", bind_address, ":", port, "\n");
+        return false;
+    }
+    return true;
+}
+
+} // namespace ymk::build
@@ -0,0 +1,129 @@
+#include <build/glob_cache.h>
+#include <core/batch_stat.h>
+#include <core/glob.h>
+#include <core/stat.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <unordered_set>
+
+namespace stdfs = std::filesystem;
+
+namespace ymk::build
+{
+
+// what is compared for a watched path, the rest of the stamp is zeroed.
+// a file only matters by existing, a directory by its listing (mtime + identity)
+static FileStamp watch_stamp(const FileStamp &stamp, bool is_dir) {
+    if (is_dir) return stamp;
+
+    FileStamp reduced;
+    reduced.exists = stamp.exists;
+    return reduced;
+}
+
+static bool unchanged(const WatchStamp &w) {
+    bool is_dir = FsSnapshot::is_dir(w.path);
+    return is_dir == w.is_dir && watch_stamp(FsSnapshot::stat(w.path), is_dir) == w.stamp;
+}
+
+void GlobCache::load(const string &root) {
+    path = root + "/.ymake.globs";
+    GlobFile::read(path, dirs, globs);
+}
+
+void GlobCache::save() {
+    if (!dirty) return;
+
+    // listings nothing refers to anymore (patterns changed, directories removed)
+    std::unordered_set<string> used;
+    for (const auto& rec : globs) {
+        for (const auto& w : rec.watched) {
+            if (w.is_dir) used.insert(w.path);
+        }
+    }
+    for (auto it = dirs.begin(); it != dirs.end();) {
+        it = used.count(it->first) ? std::next(it) : dirs.erase(it);
+    }
+
+    if (!GlobFile::write(path, dirs, globs)) {
+        LOGFMT(PROJNAME, "cache", YELLOW_TEXT("[WARN]: "), "Cannot write ", path, ", sources will be searched again next build\n");
+        return;
+    }
+    dirty = false;
+}
+
+vector<vector<string>> GlobCache::resolve_all(const vector<vector<string>> &pattern_sets) {
+    // results are absolute, the working directory is part of the key
+    Hasher hasher;
+    hasher.update_str(stdfs::current_path().string());
+    for (const auto& set : pattern_sets) {
+        hasher.update_u64(set.size());
+        for (const auto& pattern : set) hasher.update_str(pattern);
+    }
+    Hash128 key = hasher.digest();
+
+    auto found = std::find_if(globs.begin(), globs.end(), [&](const GlobRecord &rec) { return rec.key == key; });
+
+    // ----- nothing the last walk looked at changed: its result as is
+    if (found != globs.end()) {
+        vector<string> paths;
+        paths.reserve(found->watched.size());
+        for (const auto& w : found->watched) paths.push_back(w.path);
+        BatchStat::prefetch(paths);
+
+        if (std::all_of(found->watched.begin(), found->watched.end(), unchanged)) {
+            std::rotate(globs.begin(), found, found + 1);
+            return globs.front().results;
+        }
+    }
+
+    // ----- walk again, directories that kept their stamp aren't listed from disk
+    {
+        vector<string> paths;
+        paths.reserve(dirs.size());
+        for (const auto& [dir, rec] : dirs) paths.push_back(dir);
+        BatchStat::prefetch(paths);
+
+        for (const auto& [dir, rec] : dirs) {
+            if (FsSnapshot::is_dir(dir) && FsSnapshot::stat(dir) == rec.stamp) {
+                FsSnapshot::insert_listing(dir, rec.entries);
+            }
+        }
+    }
+
+    u64 started = FileStat::now_ns();
+
+    vector<string> watched;
+    GlobRecord rec;
+    rec.key     = key;
+    rec.results = fs::glob::resolve_all(pattern_sets, &watched);
+
+    std::sort(watched.begin(), watched.end());
+    watched.erase(std::unique(watched.begin(), watched.end()), watched.end());
+
+    for (auto& watched_path : watched) {
+        bool is_dir     = FsSnapshot::is_dir(watched_path);
+        FileStamp stamp = watch_stamp(FsSnapshot::stat(watched_path), is_dir);
+
+        // could change again without the mtime moving, list it next time
+        if (is_dir && stamp.mtime_ns + RACY_NS > started) {
+            stamp.mtime_ns = 0;
+            dirs.erase(watched_path);
+        } else if (is_dir) {
+            FsSnapshot::Listing listing = FsSnapshot::list(watched_path);
+            if (listing) dirs[watched_path] = DirRecord{stamp, std::move(listing)};
+        }
+
+        rec.watched.push_back({std::move(watched_path), stamp, is_dir});
+    }
+
+    if (found != globs.end()) globs.erase(found);
+    globs.insert(globs.begin(), std::move(rec));
+    if (globs.size() > MAX_RECORDS) globs.resize(MAX_RECORDS);
+
+    dirty = true;
+    return globs.front().results;
+}
+
+} // namespace ymk::build
@@ -0,0 +1,142 @@
+#include <build/hash.h>
+#include <core/mmap.h>
+
+#include <cstring>
+#include <filesystem>
+
+// the whole implementation, inlined into this file only
+#define XXH_INLINE_ALL
+#include <xxhash/xxhash.h>
+
+namespace ymk::build
+{
+
+static_assert(sizeof(XXH3_state_t) <= Hasher::STATE_SIZE, "Hasher::STATE_SIZE can't hold XXH3_state_t");
+static_assert(alignof(XXH3_state_t) <= Hasher::STATE_ALIGN, "Hasher::STATE_ALIGN is too small for XXH3_state_t");
+
+static inline XXH3_state_t* as_state(unsigned char* state) { return (XXH3_state_t*)state; }
+static inline const XXH3_state_t* as_state(const unsigned char* state) { return (const XXH3_state_t*)state; }
+
+static inline Hash128 to_hash(XXH128_hash_t h) {
+    Hash128 out;
+    out.lo = h.low64;
+    out.hi = h.high64;
+    return out;
+}
+
+// ----- Hash128
+string Hash128::to_hex() const {
+    static const char* digits = "0123456789abcdef";
+
+    string out(32, '0');
+    for (i32 i = 0; i < 16; i++) {
+        out[15 - i] = digits[(hi >> (i * 4)) & 0xF];
+        out[31 - i] = digits[(lo >> (i * 4)) & 0xF];
+    }
+    return out;
+}
+
+bool Hash128::from_hex(const string& hex, Hash128& out) {
+    if (hex.size() != 32) return false;
+
+    u64 words[2] = {0, 0};
+    for (usize i = 0; i < 32; i++) {
+        char c = hex[i];
+        u64 v;
+        if (c >= '0' && c <= '9') v = c - '0';
+        else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+        else return false;
+
+        words[i / 16] = (words[i / 16] << 4) | v;
+    }
+
+    out.hi = words[0];
+    out.lo = words[1];
+    return true;
+}
+
+// ----- Hasher
+Hasher::Hasher() {
+    XXH3_128bits_reset(as_state(state));
+}
+
+void Hasher::update(const void* data, usize size) {
+    XXH3_128bits_update(as_state(state), data, size);
+}
+
+void Hasher::update_str(const string& str) {
+    update_u64(str.size());
+    update(str.data(), str.size());
+}
+
+void Hasher::update_u64(u64 value) {
+    unsigned char bytes[8];
+    memcpy(bytes, &value, sizeof(bytes));
+    update(bytes, sizeof(bytes));
+}
+
+Hash128 Hasher::digest() const {
+    return to_hash(XXH3_128bits_digest(as_state(state)));
+}
+
+Hash128 Hasher::of(const void* data, usize size) {
+    return to_hash(XXH3_128bits(data, size));
+}
+
+Hash128 Hasher::of(const string& str) {
+    return of(str.data(), str.size());
+}
+
+bool hash_file(const string& path, Hash128& out) {
+    // mapped, so a large archive isn't copied through a buffer first
+    MappedFile file;
+    if (file.open(path)) {
+        out = Hasher::of(file.data(), file.size());
+        return true;
+    }
+
+    // mapping an empty file fails, it still has a hash
+    std::error_code ec;
+    if (std::filesystem::is_regular_file(path, ec) && std::filesystem::file_size(path, ec) == 0 && !ec) {
+        out = Hasher::of(nullptr, 0);
+        return true;
+    }
+    return false;
+}
+
+Hash128 hash_command(const CompileCmd& cmd) {
+    Hasher h;
+    h.update_str(cmd.program);
+    h.update_u64(cmd.arg_count());
+    cmd.for_each_arg([&](const string& arg) { h.update_str(arg); });
+    return h.digest();
+}
+
+Hash128 hash_config(const Project& proj, const Config& config) {
+    Hasher h;
+    auto update_opt = [&](const optional<string>& value) {
+        h.update_u64(value.has_value());
+        if (value) h.update_str(*value);
+    };
+    auto update_list = [&](const vector<string>& list) {
+        h.update_u64(list.size());
+        for (const auto& item : list) h.update_str(item);
+    };
+
+    // shared libs compile with -fPIC
+    h.update_u64((u64)proj.type);
+    h.update_str(config.compiler);
+    update_opt(config.c_std);
+    update_opt(config.cpp_std);
+    update_opt(config.optimize);
+    update_list(config.defines);
+    update_list(config.flags);
+    update_list(config.includes);
+
+    // only whether it's set, the root itself differs between checkouts
+    h.update_u64(config.path_root.has_value());
+    return h.digest();
+}
+
+} // namespace ymk::build
@@ -0,0 +1,191 @@
+#include <build/include_scanner.h>
+#include <core/mmap.h>
+#include <core/snapshot.h>
+
+#include <cstring>
+#include <filesystem>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace ymk::build
+{
+
+// ----- helpers
+static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v'; }
+
+static string dir_of(const string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == string::npos ? "." : path.substr(0, slash);
+}
+
+static string join_path(const string& dir, const string& name) {
+    return fs::path(dir + "/" + name).lexically_normal().generic_string();
+}
+
+// ----- directive parsing
+void IncludeScanner::parse(const string& path, FileInfo& info) {
+    MappedFile file;
+    if (!file.open(path)) {
+        // an empty header is fine, a missing one isn't
+        info.readable = FsSnapshot::stat(path).exists;
+        return;
+    }
+    info.readable = true;
+
+    const char* p   = (const char*)file.data();
+    const char* end = p + file.size();
+
+    // only comments need tracking, an "#include" inside a /* */ block is no directive.
+    // string literals can't start a line with '#', so they don't matter here
+    bool in_comment = false;
+
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+
+        const char* c = p;
+        p = eol + 1;
+
+        auto skip_ws = [&] {
+            while (c < eol) {
+                if (in_comment) {
+                    if (c + 1 < eol && c[0] == '*' && c[1] == '/') { in_comment = false; c += 2; }
+                    else c++;
+                } else if (is_space(*c)) {
+                    c++;
+                } else if (c + 1 < eol && c[0] == '/' && c[1] == '*') {
+                    in_comment = true;
+                    c += 2;
+                } else {
+                    break;
+                }
+            }
+        };
+
+        skip_ws();
+        if (c >= eol || *c != '#') {
+            // the rest of the line may still open a block comment
+            for (; c + 1 < eol; c++) {
+                if (in_comment && c[0] == '*' && c[1] == '/') { in_comment = false; c++; }
+                else if (!in_comment && c[0] == '/' && c[1] == '/') break;
+                else if (!in_comment && c[0] == '/' && c[1] == '*') { in_comment = true; c++; }
+            }
+            continue;
+        }
+
+        c++;
+        skip_ws();
+
+        const char* word = c;
+        while (c < eol && (isalpha((unsigned char)*c) || *c == '_')) c++;
+        string directive(word, c - word);
+        if (directive != "include" && directive != "include_next" && directive != "import") continue;
+
+        skip_ws();
+        if (c >= eol) continue;
+
+        char close = *c == '"' ? '"' : *c == '<' ? '>' : 0;
+        if (!close) {
+            info.computed = true;
+            continue;
+        }
+
+        const char* name_end = (const char*)memchr(c + 1, close, eol - c - 1);
+        if (!name_end) continue;
+
+        info.includes.push_back({string(c + 1, name_end), close == '"'});
+    }
+}
+
+vector<string> IncludeScanner::search_dirs(const Config& config) {
+    vector<string> dirs = config.includes;
+
+    // "-Idir" or "-I dir", longest option names first ("-isystem" isn't "-i" + "system")
+    static const char* options[] = {"-isystem", "-iquote", "-idirafter", "-I", "/I"};
+
+    const vector<string>& flags = config.flags;
+    for (size_t i = 0; i < flags.size(); i++) {
+        for (const char* option : options) {
+            size_t len = strlen(option);
+            if (flags[i].compare(0, len, option) != 0) continue;
+
+            if (flags[i].size() > len) dirs.push_back(flags[i].substr(len));
+            else if (i + 1 < flags.size()) dirs.push_back(flags[++i]);
+            break;
+        }
+    }
+    return dirs;
+}
+
+IncludeScanner::FileInfo& IncludeScanner::get(const string& path) {
+    std::shared_ptr<FileInfo> info;
+    {
+        std::lock_guard<std::mutex> lock(files_mutex);
+        auto& slot = files[path];
+        if (!slot) slot = std::make_shared<FileInfo>();
+        info = slot;
+    }
+
+    // parsed outside the map lock, TUs reaching the same header wait for the first one
+    std::call_once(info->parsed, [&] { parse(path, *info); });
+    return *info;
+}
+
+string IncludeScanner::resolve(const Directive& inc, const string& from_dir, const vector<string>& include_dirs, const string& dirs_key) {
+    string key = (inc.quoted ? from_dir : string()) + "|" + dirs_key + "|" + (inc.quoted ? "\"" : "<") + inc.name;
+    {
+        std::lock_guard<std::mutex> lock(resolve_mutex);
+        auto it = resolved.find(key);
+        if (it != resolved.end()) return it->second;
+    }
+
+    // quoted: the including file's directory first, then the -I dirs like <...>
+    string found;
+    if (inc.quoted && FsSnapshot::stat(join_path(from_dir, inc.name)).exists) {
+        found = join_path(from_dir, inc.name);
+    }
+    for (size_t i = 0; found.empty() && i < include_dirs.size(); i++) {
+        string candidate = join_path(include_dirs[i], inc.name);
+        if (FsSnapshot::stat(candidate).exists) found = candidate;
+    }
+
+    std::lock_guard<std::mutex> lock(resolve_mutex);
+    resolved.emplace(key, found);
+    return found;
+}
+
+bool IncludeScanner::scan(const string& src, const vector<string>& include_dirs, vector<string>& deps) {
+    string dirs_key;
+    for (const auto& dir : include_dirs) dirs_key += dir + ";";
+
+    bool complete = true;
+    std::unordered_set<string> seen = {src};
+    vector<string> queue = {src};
+
+    while (!queue.empty()) {
+        string path = std::move(queue.back());
+        queue.pop_back();
+
+        FileInfo& info = get(path);
+        if (!info.readable || info.computed) complete = false;
+
+        string from_dir = dir_of(path);
+        for (const auto& inc : info.includes) {
+            string header = resolve(inc, from_dir, include_dirs, dirs_key);
+            if (header.empty()) {
+                if (inc.quoted) complete = false;
+                continue;
+            }
+
+            if (seen.insert(header).second) {
+                deps.push_back(header);
+                queue.push_back(header);
+            }
+        }
+    }
+
+    return complete;
+}
+
+} // namespace ymk::build
@@ -0,0 +1,365 @@
+#include <build/object_store.h>
+#include <core/stat.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#ifndef IPLATFORM_WINDOWS
+    #include <sys/file.h>
+    #include <sys/ioctl.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #if defined(__linux__)
+        #include <linux/fs.h>
+    #elif defined(__APPLE__)
+        #include <sys/clonefile.h>
+    #endif
+#else
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace ymk::build
+{
+
+// ----- helpers
+
+// held for the stats read-modify-write and eviction, other builds wait
+class StoreLock {
+private:
+#ifndef IPLATFORM_WINDOWS
+    i32 fd = -1;
+#else
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#endif
+
+public:
+    explicit StoreLock(const string& path) {
+#ifndef IPLATFORM_WINDOWS
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+#else
+        handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                             nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        OVERLAPPED ov = {};
+        if (handle != INVALID_HANDLE_VALUE && !LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &ov)) {
+            CloseHandle(handle);
+            handle = INVALID_HANDLE_VALUE;
+        }
+#endif
+    }
+
+    ~StoreLock() {
+#ifndef IPLATFORM_WINDOWS
+        if (fd >= 0) ::close(fd); // drops the flock
+#else
+        if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+#endif
+    }
+
+    bool locked() const {
+#ifndef IPLATFORM_WINDOWS
+        return fd >= 0;
+#else
+        return handle != INVALID_HANDLE_VALUE;
+#endif
+    }
+};
+
+// copy-on-write clone where the filesystem has them (btrfs, xfs, apfs)
+static bool reflink(const string& from, const string& to) {
+#if defined(__linux__) && defined(FICLONE)
+    i32 in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+
+    i32 out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = out >= 0 && ioctl(out, FICLONE, in) == 0;
+
+    if (out >= 0) ::close(out);
+    ::close(in);
+    if (!ok) ::unlink(to.c_str());
+    return ok;
+#elif defined(__APPLE__)
+    return clonefile(from.c_str(), to.c_str(), 0) == 0;
+#else
+    (void)from;
+    (void)to;
+    return false;
+#endif
+}
+
+// to is replaced, never written through (it may be a hardlink into the store)
+static bool place(const string& from, const string& to, bool allow_hardlink) {
+    std::error_code ec;
+    fs::remove(to, ec);
+
+    if (reflink(from, to)) return true;
+
+    if (allow_hardlink) {
+        fs::create_hard_link(from, to, ec);
+        if (!ec) return true;
+    }
+
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
+// where the system would find program, empty if nowhere
+static string find_program(const string& program) {
+    if (program.find_first_of("/\\") != string::npos) return program;
+
+    const char* path_env = std::getenv("PATH");
+    if (!path_env) return "";
+
+#ifndef IPLATFORM_WINDOWS
+    const char separator = ':';
+    const char* suffixes[] = {""};
+#else
+    const char separator = ';';
+    const char* suffixes[] = {"", ".exe"};
+#endif
+
+    std::stringstream dirs(path_env);
+    string dir;
+    while (std::getline(dirs, dir, separator)) {
+        if (dir.empty()) continue;
+        for (const char* suffix : suffixes) {
+            string candidate = dir + "/" + program + suffix;
+            bool is_dir;
+            if (FileStat::get(candidate, &is_dir).exists && !is_dir) return candidate;
+        }
+    }
+    return "";
+}
+
+static bool write_stats(const string& path, const StoreStats& stats) {
+    string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << "hits "      << stats.hits      << "\n"
+            << "misses "    << stats.misses    << "\n"
+            << "stores "    << stats.stores    << "\n"
+            << "evictions " << stats.evictions << "\n"
+            << "files "     << stats.files     << "\n"
+            << "size "      << stats.size      << "\n";
+        if (!out.good()) return false;
+    }
+
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    return !ec;
+}
+
+// ----- ObjectStore
+string ObjectStore::entry_path(const Hash128& key) const {
+    string hex = key.to_hex();
+    return dir + "/" + hex.substr(0, 2) + "/" + hex.substr(2) + ".o";
+}
+
+bool ObjectStore::open(const string& store_dir, u64 size) {
+    std::error_code ec;
+    fs::create_directories(store_dir, ec);
+    if (ec) {
+        LOGFMT(PROJNAME, "store", YELLOW_TEXT("[WARN]: "), "Cannot create object store ", store_dir, ", building without it\n");
+        return false;
+    }
+
+    dir      = fs::absolute(store_dir).lexically_normal().string();
+    max_size = size;
+    return true;
+}
+
+void ObjectStore::hash_compile(Hasher& hasher, const CompileCmd& cmd) {
+    hasher.update_str(cmd.program);
+    hasher.update_u64(cmd.arg_count());
+    cmd.for_each_arg([&](const string& arg) { hasher.update_str(arg); });
+
+    // the binary behind the name, an upgrade in place moves its stamp.
+    // looked up once per run, every TU asks
+    static std::mutex compilers_mutex;
+    static std::unordered_map<string, FileStamp> compilers;
+
+    FileStamp stamp;
+    {
+        std::lock_guard<std::mutex> lock(compilers_mutex);
+        auto it = compilers.find(cmd.program);
+        if (it == compilers.end()) {
+            string binary = find_program(cmd.program);
+            it = compilers.emplace(cmd.program, binary.empty() ? FileStamp{} : FileStat::get(binary)).first;
+        }
+        stamp = it->second;
+    }
+    hasher.update_u64(stamp.mtime_ns);
+    hasher.update_u64(stamp.size);
+}
+
+bool ObjectStore::fetch(const Hash128& key, const string& obj) {
+    string entry = entry_path(key);
+
+    std::error_code ec;
+    if (!fs::is_regular_file(entry, ec)) {
+        misses++;
+        return false;
+    }
+
+    // the mtime is the LRU clock
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+
+    if (!place(entry, obj, true)) {
+        misses++;
+        return false;
+    }
+
+    hits++;
+    return true;
+}
+
+void ObjectStore::put(const Hash128& key, const string& obj) {
+    string entry = entry_path(key);
+
+    std::error_code ec;
+    if (fs::exists(entry, ec)) return; // same TU stored meanwhile (another worktree)
+
+    fs::create_directories(fs::path(entry).parent_path(), ec);
+
+    // written aside and renamed in, a concurrent fetch never sees half an object
+    string tmp = entry + "." + Hasher::of(obj + std::to_string(FileStat::now_ns())).to_hex().substr(0, 8) + ".tmp";
+    if (!place(obj, tmp, false)) {
+        fs::remove(tmp, ec);
+        return;
+    }
+
+    fs::rename(tmp, entry, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return;
+    }
+
+    stores++;
+    stored_bytes += FileStat::get(entry).size;
+}
+
+void ObjectStore::flush() {
+    if (!enabled()) return;
+
+    StoreLock lock(dir + "/lock");
+    if (!lock.locked()) return;
+
+    StoreStats stats;
+    read_stats(dir, stats);
+
+    u64 stored  = stores.exchange(0);
+    stats.hits   += hits.exchange(0);
+    stats.misses += misses.exchange(0);
+    stats.stores += stored;
+    stats.files  += stored;
+    stats.size   += stored_bytes.exchange(0);
+
+    // ----- eviction: the whole store, oldest use first
+    if (stats.size > max_size) {
+        struct Item {
+            fs::file_time_type used;
+            u64 size;
+            fs::path path;
+        };
+
+        vector<Item> items;
+        std::error_code ec;
+        for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            if (!it->is_regular_file(ec) || it->path().extension() != ".o") continue;
+            items.push_back({it->last_write_time(ec), (u64)it->file_size(ec), it->path()});
+        }
+        std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.used < b.used; });
+
+        u64 total = 0;
+        for (const auto& item : items) total += item.size;
+
+        u64 target = max_size / 100 * EVICT_TO_PERCENT;
+        usize kept = items.size();
+        for (const auto& item : items) {
+            if (total <= target) break;
+            if (!fs::remove(item.path, ec)) continue;
+
+            total -= item.size;
+            kept--;
+            stats.evictions++;
+        }
+
+        stats.files = kept;
+        stats.size  = total;
+    }
+
+    write_stats(dir + "/stats", stats);
+}
+
+bool ObjectStore::read_stats(const string& store_dir, StoreStats& out) {
+    out = StoreStats{};
+
+    std::ifstream in(store_dir + "/stats");
+    if (!in.is_open()) return false;
+
+    string name;
+    u64 value;
+    while (in >> name >> value) {
+        if (name == "hits") out.hits = value;
+        else if (name == "misses") out.misses = value;
+        else if (name == "stores") out.stores = value;
+        else if (name == "evictions") out.evictions = value;
+        else if (name == "files") out.files = value;
+        else if (name == "size") out.size = value;
+    }
+    return true;
+}
+
+bool ObjectStore::clear(const string& store_dir) {
+    StoreLock lock(store_dir + "/lock");
+    if (!lock.locked()) return false;
+
+    // only what we put there: the two-digit entry directories and the stats
+    std::error_code ec;
+    for (fs::directory_iterator it(store_dir, ec), end; !ec && it != end; it.increment(ec)) {
+        string name = it->path().filename().string();
+        bool ours = (it->is_directory(ec) && name.size() == 2 && isxdigit((unsigned char)name[0]) &&
+                     isxdigit((unsigned char)name[1])) || name == "stats";
+        if (ours) fs::remove_all(it->path(), ec);
+    }
+    return !ec;
+}
+
+bool ObjectStore::parse_size(const string& text, u64& out) {
+    if (text.empty() || !isdigit((unsigned char)text[0])) return false;
+
+    usize end = 0;
+    u64 value;
+    try {
+        value = std::stoull(text, &end);
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    string unit = text.substr(end);
+    if (unit.size() > 1 && (unit.back() == 'B' || unit.back() == 'b')) unit.pop_back();
+
+    u32 shift = 0;
+    if (unit.empty()) shift = 0;
+    else if (unit == "K" || unit == "k") shift = 10;
+    else if (unit == "M" || unit == "m") shift = 20;
+    else if (unit == "G" || unit == "g") shift = 30;
+    else if (unit == "T" || unit == "t") shift = 40;
+    else return false;
+
+    out = value << shift;
+    return true;
+}
+
+} // namespace ymk::build
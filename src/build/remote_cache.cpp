@@ -0,0 +1,175 @@
+#include <build/remote_cache.h>
+#include <core/stat.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+namespace ymk::build
+{
+
+bool RemoteCache::open(const string& text, bool only_read, usize transfers) {
+    if (!Url::parse(text, url)) {
+        LOGFMT(PROJNAME, "remote", YELLOW_TEXT("[WARN]: "), "Not an http:// url: ", text, ", building without the remote cache\n");
+        return false;
+    }
+
+    url_text      = text;
+    read_only     = only_read;
+    max_transfers = std::max<usize>(1, transfers);
+    uploads       = std::make_unique<ThreadPool>(max_transfers);
+    return true;
+}
+
+std::unique_ptr<HttpConnection> RemoteCache::acquire() {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    pool_cv.wait(lock, [&] { return !idle.empty() || in_use + idle.size() < max_transfers; });
+
+    in_use++;
+    if (!idle.empty()) {
+        auto conn = std::move(idle.back());
+        idle.pop_back();
+        return conn;
+    }
+    return std::make_unique<HttpConnection>();
+}
+
+void RemoteCache::release(std::unique_ptr<HttpConnection> conn) {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        in_use--;
+        if (conn->is_open()) idle.push_back(std::move(conn));
+    }
+    pool_cv.notify_one();
+}
+
+i32 RemoteCache::exchange(const string& method, const string& path, const string& body, string* response) {
+    auto conn = acquire();
+
+    i32 status = 0;
+    for (i32 attempt = 0; attempt < 2 && status == 0 && !broken; attempt++) {
+        bool reused = conn->is_open();
+        if (!reused && !conn->connect(url)) break;
+
+        status = conn->request(method, url.host, url.prefix + path, body, response);
+
+        // a fresh connection that failed won't do better the second time
+        if (status == 0 && !reused) break;
+    }
+
+    release(std::move(conn));
+    return status;
+}
+
+void RemoteCache::fail(const string& what) {
+    errors++;
+    if (broken.exchange(true)) return;
+
+    LOGFMT(
+        PROJNAME,
+        "remote",
+        YELLOW_TEXT("[WARN]: "), what, " ", url_text, " failed, not using the remote cache for the rest of this build\n"
+    );
+}
+
+bool RemoteCache::fetch(const char* kind, const Hash128& key, const string& path) {
+    if (!enabled()) return false;
+
+    auto start = std::chrono::steady_clock::now();
+
+    string body;
+    i32 status = exchange("GET", "/" + string(kind) + "/" + key.to_hex(), "", &body);
+
+    get_count++;
+    get_ns += (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    if (status == 404) {
+        misses++;
+        return false;
+    }
+    if (status < 200 || status >= 300) {
+        fail("GET from");
+        return false;
+    }
+
+    // written aside and renamed in, path may be a hardlink into the object store
+    string tmp = path + ".remote";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(body.data(), (std::streamsize)body.size());
+        if (!out.good()) {
+            misses++;
+            return false;
+        }
+    }
+
+    // the protocol carries no file mode, linked outputs are programs and libraries
+    std::error_code ec;
+    if (string(kind) == "link") {
+        auto exec = fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec;
+        fs::permissions(tmp, exec, fs::perm_options::add, ec);
+    }
+
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        misses++;
+        return false;
+    }
+
+    hits++;
+    bytes_down += body.size();
+    return true;
+}
+
+void RemoteCache::put(const char* kind, const Hash128& key, const string& path) {
+    if (!enabled() || read_only) return;
+
+    // read now, the file may be replaced before the upload runs
+    string body;
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return;
+        body.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    string target = "/" + string(kind) + "/" + key.to_hex();
+    uploads->add_task([this, target, body = std::move(body)] {
+        if (!enabled()) return;
+
+        i32 status = exchange("PUT", target, body, nullptr);
+        if (status < 200 || status >= 300) {
+            fail("PUT to");
+            return;
+        }
+
+        uploaded++;
+        bytes_up += body.size();
+    });
+}
+
+void RemoteCache::flush() {
+    if (max_transfers == 0) return;
+    uploads->wait_idle();
+
+    u64 lookups = hits + misses;
+    if (lookups == 0 && uploaded == 0 && errors == 0) return;
+
+    u64 avg_us = get_count ? get_ns / get_count / 1000 : 0;
+    LOGFMT(
+        PROJNAME,
+        "remote",
+        CYAN_TEXT("remote cache: "),
+        (u64)hits, " hits, ", (u64)misses, " misses",
+        lookups ? " (" + std::to_string(hits * 100 / lookups) + "% hit)" : string(""),
+        ", ", (u64)uploaded, " uploaded, ",
+        avg_us / 1000, ".", (avg_us % 1000) / 100, " ms per GET, ",
+        bytes_down / 1024, " KiB down, ", bytes_up / 1024, " KiB up",
+        read_only ? " [read-only]" : "", "\n"
+    );
+}
+
+} // namespace ymk::build
@@ -0,0 +1,229 @@
+#include <core/batch_stat.h>
+#include <core/snapshot.h>
+#include <core/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_set>
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define YMK_IO_URING 1
+    #endif
+#endif
+
+#ifdef YMK_IO_URING
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cerrno>
+    #include <cstring>
+#endif
+
+namespace ymk {
+
+// ----- thread fallback
+static void stat_with_threads(const vector<string>& paths) {
+    usize workers = std::min<usize>(std::max(1u, std::thread::hardware_concurrency()), 16);
+
+    // a handful of files isn't worth a thread
+    if (paths.size() < 64) workers = 1;
+
+    std::atomic<usize> next{0};
+    auto work = [&] {
+        for (usize i = next++; i < paths.size(); i = next++) {
+            bool is_dir;
+            FileStamp stamp = FileStat::get(paths[i], &is_dir);
+            FsSnapshot::insert(paths[i], stamp, is_dir);
+        }
+    };
+
+    vector<std::thread> threads;
+    for (usize i = 1; i < workers; i++) threads.emplace_back(work);
+    work();
+    for (auto& t : threads) t.join();
+}
+
+#ifdef YMK_IO_URING
+
+// ----- io_uring, raw syscalls (no liburing dependency)
+class StatRing {
+private:
+    i32 fd = -1;
+
+    void* sq_ptr = nullptr;
+    void* cq_ptr = nullptr;
+    usize sq_len = 0;
+    usize cq_len = 0;
+
+    io_uring_sqe* sqes = nullptr;
+    usize sqes_len     = 0;
+
+    unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+    unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    unsigned entries = 0;
+
+public:
+    ~StatRing() {
+        if (sqes) munmap(sqes, sqes_len);
+        if (cq_ptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_len);
+        if (sq_ptr) munmap(sq_ptr, sq_len);
+        if (fd >= 0) close(fd);
+    }
+
+    bool setup(unsigned count) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        fd = (i32)syscall(__NR_io_uring_setup, count, &params);
+        if (fd < 0) return false; // old kernel, seccomp, io_uring_disabled...
+
+        sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_len = cq_len = std::max(sq_len, cq_len);
+
+        sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) { sq_ptr = nullptr; return false; }
+
+        cq_ptr = single ? sq_ptr
+                        : mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) { cq_ptr = nullptr; return false; }
+
+        sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqe_ptr = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqe_ptr == MAP_FAILED) return false;
+        sqes = (io_uring_sqe*)sqe_ptr;
+
+        char* sq = (char*)sq_ptr;
+        sq_head  = (unsigned*)(sq + params.sq_off.head);
+        sq_tail  = (unsigned*)(sq + params.sq_off.tail);
+        sq_mask  = (unsigned*)(sq + params.sq_off.ring_mask);
+        sq_array = (unsigned*)(sq + params.sq_off.array);
+
+        char* cq = (char*)cq_ptr;
+        cq_head = (unsigned*)(cq + params.cq_off.head);
+        cq_tail = (unsigned*)(cq + params.cq_off.tail);
+        cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes    = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+        entries = params.sq_entries;
+        return true;
+    }
+
+    // false if the ring itself failed, per-file errors land in results
+    bool run(const vector<string>& paths, vector<struct statx>& bufs, vector<i32>& results) {
+        bufs.resize(paths.size());
+        results.assign(paths.size(), -EAGAIN);
+
+        for (usize begin = 0; begin < paths.size(); begin += entries) {
+            unsigned batch = (unsigned)std::min<usize>(entries, paths.size() - begin);
+
+            // ----- queue one statx per path
+            unsigned tail = *sq_tail;
+            for (unsigned i = 0; i < batch; i++) {
+                unsigned index   = (tail + i) & *sq_mask;
+                io_uring_sqe* sq = &sqes[index];
+                memset(sq, 0, sizeof(*sq));
+
+                sq->opcode      = IORING_OP_STATX;
+                sq->fd          = AT_FDCWD;
+                sq->addr        = (u64)(uintptr_t)paths[begin + i].c_str();
+                sq->len         = STATX_BASIC_STATS;
+                sq->off         = (u64)(uintptr_t)&bufs[begin + i];
+                sq->statx_flags = 0; // follow symlinks, same as stat()
+                sq->user_data   = begin + i;
+
+                sq_array[index] = index;
+            }
+            __atomic_store_n(sq_tail, tail + batch, __ATOMIC_RELEASE);
+
+            // ----- submit and wait for the whole batch
+            unsigned to_submit = batch, reaped = 0;
+            while (reaped < batch) {
+                i32 ret = (i32)syscall(__NR_io_uring_enter, fd, to_submit, batch - reaped, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (ret < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                to_submit -= std::min<unsigned>(to_submit, (unsigned)ret);
+
+                unsigned head = *cq_head;
+                unsigned end  = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+                for (; head != end; head++, reaped++) {
+                    const io_uring_cqe& cqe = cqes[head & *cq_mask];
+                    if (cqe.user_data < results.size()) results[cqe.user_data] = cqe.res;
+                }
+                __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            }
+        }
+        return true;
+    }
+};
+
+static bool stat_with_io_uring(const vector<string>& paths) {
+    StatRing ring;
+    if (!ring.setup(BatchStat::RING_ENTRIES)) return false;
+
+    vector<struct statx> bufs;
+    vector<i32> results;
+    if (!ring.run(paths, bufs, results)) return false;
+
+    for (usize i = 0; i < paths.size(); i++) {
+        i32 res = results[i];
+
+        // kernel without IORING_OP_STATX (< 5.6) or something odd, ask the usual way
+        if (res == -EINVAL || res == -EOPNOTSUPP || res == -EAGAIN) {
+            bool is_dir;
+            FileStamp stamp = FileStat::get(paths[i], &is_dir);
+            FsSnapshot::insert(paths[i], stamp, is_dir);
+            continue;
+        }
+
+        FileStamp stamp;
+        bool is_dir = false;
+        if (res == 0) {
+            const struct statx& st = bufs[i];
+            stamp.exists   = true;
+            stamp.mtime_ns = (u64)st.stx_mtime.tv_sec * 1000000000ull + (u64)st.stx_mtime.tv_nsec;
+            stamp.size     = (u64)st.stx_size;
+            stamp.inode    = (u64)st.stx_ino;
+            is_dir         = S_ISDIR(st.stx_mode);
+        }
+        FsSnapshot::insert(paths[i], stamp, is_dir);
+    }
+    return true;
+}
+
+#endif
+
+// set once the first ring setup fails, no point retrying every project
+static std::atomic<bool> ring_unavailable{false};
+
+void BatchStat::prefetch(const vector<string>& paths) {
+    // only what the snapshot doesn't know yet, once each
+    vector<string> todo;
+    std::unordered_set<string> seen;
+    for (const auto& path : paths) {
+        if (!FsSnapshot::known(path) && seen.insert(path).second) todo.push_back(path);
+    }
+    if (todo.empty()) return;
+
+#ifdef YMK_IO_URING
+    if (!ring_unavailable) {
+        if (stat_with_io_uring(todo)) return;
+        ring_unavailable = true;
+    }
+#endif
+
+    stat_with_threads(todo);
+}
+
+} // namespace ymk
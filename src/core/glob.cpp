@@ -1,97 +1,494 @@
 #include <core/glob.h>
+#include <core/snapshot.h>
+#include <core/mt.h>
 
 #include <algorithm>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace ymk::fs {
 
+// chars that make a segment a pattern, '\' escapes them
+static bool is_meta(char c) {
+    return c == '*' || c == '?' || c == '[' || c == ']' || c == '{' || c == '}' || c == '!' || c == '\\';
+}
+
+// paths inside a walk are built the same way everywhere, so roots compare as strings
+static string join(const string& dir, const string& name) {
+    if (dir == ".") return name;
+    if (!dir.empty() && dir.back() == '/') return dir + name;
+    return dir + "/" + name;
+}
+
+// a ".." segment leaves whatever it's under
+static bool has_dotdot(const string& path) {
+    for (usize start = 0; start <= path.size();) {
+        usize end = path.find('/', start);
+        if (end == string::npos) end = path.size();
+        if (path.compare(start, end - start, "..") == 0) return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+// true if dir is a proper ancestor of path, lexically (a walk from dir gets there)
+static bool is_under(const string& path, const string& dir) {
+    if (has_dotdot(path)) return false;
+    if (dir == ".") return path != "." && path[0] != '/';
+    if (dir == "/") return path.size() > 1 && path[0] == '/';
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/';
+}
+
+struct glob::Walk
+{
+    vector<Compiled> includes;
+    vector<u32> include_set;
+    vector<Compiled> excludes;
+    vector<u32> exclude_set;
+
+    // roots that sit below another root: they join the walk when it gets there
+    std::unordered_map<string, vector<u32>> nested_roots;
+    std::unordered_set<string> on_the_way; // every ancestor of a nested root
+    std::unordered_set<string> reached;    // nested roots a walk got to, guarded by results_mutex
+
+    ThreadPool* pool = nullptr;
+
+    std::mutex results_mutex;
+    vector<vector<string>> results;
+    vector<string>* watched = nullptr; // guarded by results_mutex too
+};
+
 vector<string> glob::resolve(const vector<string>& patterns) {
-    vector<string> results;
+    return std::move(resolve_all({patterns})[0]);
+}
 
-    for (const auto& pat_str : patterns) {
-        stdfs::path pattern(pat_str);
-        match_pattern(pattern, results);
+vector<vector<string>> glob::resolve_all(const vector<vector<string>>& pattern_sets, vector<string>* watched) {
+    Walk plan;
+    plan.results.resize(pattern_sets.size());
+    plan.watched = watched;
+
+    // compile every pattern once, braces become separate patterns
+    for (u32 set = 0; set < pattern_sets.size(); set++) {
+        for (const auto& pat_str : pattern_sets[set]) {
+            bool exclude = !pat_str.empty() && pat_str[0] == '!';
+            string body  = exclude ? pat_str.substr(1) : pat_str;
+
+            for (const auto& expanded : expand_braces(body)) {
+                Compiled pat = compile(expanded, exclude);
+                if (pat.segments.empty()) continue;
+
+                (exclude ? plan.excludes : plan.includes).push_back(std::move(pat));
+                (exclude ? plan.exclude_set : plan.include_set).push_back(set);
+            }
+        }
+    }
+
+    // excludes are matched from the top, catch them up to where a walk starts
+    auto excludes_at = [&](const Compiled& include, u32 depth) {
+        vector<States> states;
+        for (const auto& exclude : plan.excludes) {
+            States st = closure(exclude, {0});
+            for (u32 i = 0; i < depth && !st.empty(); i++) st = step(exclude, st, include.segments[i].text);
+            states.push_back(std::move(st));
+        }
+        return states;
+    };
+
+    // ----- plan: plain files right away, one walk per top-most root
+    std::map<string, vector<u32>> roots;
+    for (u32 i = 0; i < plan.includes.size(); i++) {
+        const Compiled& include = plan.includes[i];
+        u32 set = plan.include_set[i];
+
+        // no wildcard at all, the pattern names a single file
+        if (include.root_len == include.segments.size()) {
+            vector<States> excl = excludes_at(include, include.root_len);
+
+            bool dropped = false;
+            for (usize e = 0; e < plan.excludes.size(); e++) {
+                if (plan.exclude_set[e] == set && accepts(plan.excludes[e], excl[e])) dropped = true;
+            }
+            if (watched) watched->push_back(include.root);
+            if (!dropped && FsSnapshot::is_file(include.root)) {
+                plan.results[set].push_back(stdfs::absolute(include.root).lexically_normal().string());
+            }
+            continue;
+        }
+
+        roots[include.root].push_back(i);
+    }
+
+    // a top-most root starts a walk, unless it doesn't exist (e.g. "src" folder missing)
+    auto start_walk = [&](vector<WalkTask>& tasks, const string& root, const vector<u32>& members) {
+        if (watched) watched->push_back(root);
+        if (!FsSnapshot::is_dir(root)) return;
+
+        const Compiled& first = plan.includes[members[0]];
+        WalkTask task;
+        task.dir            = root;
+        task.exclude_states = excludes_at(first, first.root_len);
+        for (u32 i : members) {
+            task.active.emplace_back(i, closure(plan.includes[i], {plan.includes[i].root_len}));
+        }
+        tasks.push_back(std::move(task));
+    };
+
+    auto run_walks = [&](vector<WalkTask>& tasks) {
+        if (tasks.empty()) return;
+
+        ThreadPool pool;
+        plan.pool = &pool;
+        for (auto& task : tasks) {
+            pool.add_task([&plan, task = std::move(task)]() mutable { walk(plan, std::move(task)); });
+        }
+        pool.wait_idle();
+        plan.pool = nullptr;
+    };
+
+    vector<WalkTask> tops;
+    for (const auto& [root, members] : roots) {
+        bool nested = false;
+        for (const auto& [other, _] : roots) {
+            if (is_under(root, other)) nested = true;
+        }
+
+        if (nested) {
+            plan.nested_roots[root] = members;
+            for (stdfs::path p = stdfs::path(root).parent_path(); !p.empty() && p != p.parent_path(); p = p.parent_path()) {
+                plan.on_the_way.insert(p.generic_string());
+            }
+            continue;
+        }
+
+        start_walk(tops, root, members);
+    }
+
+    // ----- walk, each directory is a task, subdirectories fan out across the pool
+    run_walks(tops);
+
+    // nested roots the walks didn't get to (outside the parent lexically, or behind a
+    // symlinked directory) are walked on their own, top-most first, until every one was seen
+    while (true) {
+        vector<WalkTask> missed;
+        vector<string> started;
+        for (const auto& [root, members] : plan.nested_roots) {
+            if (plan.reached.count(root)) continue;
+
+            bool covered = false;
+            for (const auto& [other, _] : plan.nested_roots) {
+                if (!plan.reached.count(other) && is_under(root, other)) covered = true;
+            }
+            if (covered) continue;
+
+            started.push_back(root);
+            start_walk(missed, root, members);
+        }
+        if (started.empty()) break;
+
+        for (auto& root : started) plan.reached.insert(std::move(root));
+        run_walks(missed);
     }
 
     // sort and remove duplicates
-    std::sort(results.begin(), results.end());
-    results.erase(std::unique(results.begin(), results.end()), results.end());
+    for (auto& results : plan.results) {
+        std::sort(results.begin(), results.end());
+        results.erase(std::unique(results.begin(), results.end()), results.end());
+    }
 
-    return results;
+    return std::move(plan.results);
 }
 
-void glob::match_pattern(const stdfs::path& pattern_path, vector<string>& results) {
-    string full_pattern = pattern_path.string();
+// ----- compiling
+vector<string> glob::expand_braces(const string& pattern) {
+    // find the first top-level {...} that isn't escaped
+    size_t open = string::npos, close = string::npos;
+    vector<size_t> commas;
+    i32 depth = 0;
 
-    // 1. Find the "Root" (The part before any wildcards)
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size() && is_meta(pattern[i + 1])) {
+            i++;
+            continue;
+        }
 
-    // find the root of dir tree
-    //    ex: "src/renderer/**/*.cpp" -> root: "src/renderer"
-    stdfs::path root;
-    stdfs::path remaining;
-    
-    auto it = pattern_path.begin();
-    stdfs::path current_builder;
-    
-    // iterate path comps until we hit a wildcard
-    bool wildcard_found = false;
-    while(it != pattern_path.end()) {
-        string part = it->string();
-        if (part.find('*') != std::string::npos) {
-            wildcard_found = true;
-            break; 
+        if (c == '{') {
+            if (depth++ == 0) open = i;
+        } else if (c == '}' && depth > 0) {
+            if (--depth == 0) {
+                close = i;
+                break;
+            }
+        } else if (c == ',' && depth == 1) {
+            commas.push_back(i);
         }
-        current_builder /= *it;
-        ++it;
     }
 
-    if (!wildcard_found) {
-        // if no wildcard, check existence directly
-        if (stdfs::exists(current_builder) && stdfs::is_regular_file(current_builder)) {
-            results.push_back(stdfs::absolute(current_builder).string());
+    // no (balanced) braces left
+    if (close == string::npos) return {pattern};
+
+    string prefix = pattern.substr(0, open);
+    string suffix = pattern.substr(close + 1);
+
+    vector<string> results;
+    size_t begin = open + 1;
+    commas.push_back(close);
+    for (size_t end : commas) {
+        // the alternative may hold more braces, and so may the suffix
+        for (auto& expanded : expand_braces(prefix + pattern.substr(begin, end - begin) + suffix)) {
+            results.push_back(std::move(expanded));
         }
-        return;
+        begin = end + 1;
+    }
+    return results;
+}
+
+glob::Compiled glob::compile(const string& pattern, bool exclude) {
+    Compiled pat;
+    pat.exclude = exclude;
+
+    // split on '/' (and '\' unless it escapes a glob char)
+    vector<string> parts(1);
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size() && is_meta(pattern[i + 1])) {
+            parts.back() += c;
+            parts.back() += pattern[++i];
+        } else if (c == '/' || c == '\\') {
+            parts.emplace_back();
+        } else {
+            parts.back() += c;
+        }
+    }
+
+    for (size_t i = 0; i < parts.size(); i++) {
+        const string& part = parts[i];
+
+        // "a//b", "./a" and a trailing '/' add nothing, a leading '/' is the root
+        if ((part.empty() && i != 0) || part == ".") continue;
+
+        Segment seg;
+        seg.globstar = part == "**";
+        seg.literal  = std::none_of(part.begin(), part.end(), [](char c) {
+            return c == '*' || c == '?' || c == '[' || c == '\\';
+        });
+        seg.text = part;
+
+        // "**" twice in a row is the same as once
+        if (seg.globstar && !pat.segments.empty() && pat.segments.back().globstar) continue;
+        pat.segments.push_back(std::move(seg));
     }
 
-    root = current_builder;
-    
-    // if the root doesn't exist (e.g. "src" folder missing), just return
-    if (root.empty()) root = "."; // handle case where pattern starts with wildcard
-    if (!stdfs::exists(root)) return;
+    // literal prefix -> where walking starts
+    while (pat.root_len < pat.segments.size() && pat.segments[pat.root_len].literal) {
+        const string& text = pat.segments[pat.root_len].text;
+        if (pat.root_len == 0) pat.root = text.empty() ? "/" : text;
+        else pat.root += (pat.root.back() == '/' ? "" : "/") + text;
+        pat.root_len++;
+    }
+    if (pat.root.empty()) pat.root = ".";
+
+    return pat;
+}
+
+// ----- matching
+bool glob::match_segment(const string& name, const string& pattern) {
+    size_t n = 0, p = 0;
+
+    // last '*' seen, retried with one more char whenever the rest fails
+    size_t star_p = string::npos, star_n = 0;
+
+    while (n < name.size()) {
+        bool matched = false;
+        size_t next_p = p;
+
+        if (p < pattern.size()) {
+            char c = pattern[p];
+
+            if (c == '*') {
+                star_p = p++;
+                star_n = n;
+                continue;
+            }
+
+            if (c == '?') {
+                matched = true;
+                next_p  = p + 1;
+            } else if (c == '[') {
+                // [!a-z] / [^a-z], a ']' right after the '[' is literal
+                size_t q    = p + 1;
+                bool negate = q < pattern.size() && (pattern[q] == '!' || pattern[q] == '^');
+                if (negate) q++;
 
-    // determine filename pattern (ex: "*.cpp")
-    string filename_pattern = pattern_path.filename().string();
+                bool in_set = false;
+                bool first  = true;
+                for (; q < pattern.size() && (first || pattern[q] != ']'); q++, first = false) {
+                    char lo = pattern[q];
+                    if (lo == '\\' && q + 1 < pattern.size()) lo = pattern[++q];
+
+                    char hi = lo;
+                    if (q + 2 < pattern.size() && pattern[q + 1] == '-' && pattern[q + 2] != ']') {
+                        hi = pattern[q + 2];
+                        if (hi == '\\' && q + 3 < pattern.size()) hi = pattern[++q + 2];
+                        q += 2;
+                    }
+                    if (name[n] >= lo && name[n] <= hi) in_set = true;
+                }
 
-    // recursive search
-    try {
-        for (const auto& entry : stdfs::recursive_directory_iterator(root)) {
-            if (entry.is_regular_file()) {
-                if (matches(entry.path().filename().string(), filename_pattern)) {
-                    results.push_back(stdfs::absolute(entry.path()).string());
+                if (q < pattern.size()) {
+                    matched = in_set != negate;
+                    next_p  = q + 1;
+                } else {
+                    // no closing ']', a plain '['
+                    matched = name[n] == '[';
+                    next_p  = p + 1;
                 }
+            } else {
+                if (c == '\\' && p + 1 < pattern.size()) c = pattern[++p];
+                matched = name[n] == c;
+                next_p  = p + 1;
             }
         }
-    } catch (const stdfs::filesystem_error& e) {
+
+        if (matched) {
+            p = next_p;
+            n++;
+        } else if (star_p != string::npos) {
+            p = star_p + 1;
+            n = ++star_n;
+        } else {
+            return false;
+        }
+    }
+
+    // name used up, only '*'s may be left
+    while (p < pattern.size() && pattern[p] == '*') p++;
+    return p == pattern.size();
+}
+
+glob::States glob::closure(const Compiled& pat, States states) {
+    // "**" may also match zero segments, so the one after it is reachable too
+    for (usize i = 0; i < states.size(); i++) {
+        u32 s = states[i];
+        if (s < pat.segments.size() && pat.segments[s].globstar &&
+            std::find(states.begin(), states.end(), s + 1) == states.end()) {
+            states.push_back(s + 1);
+        }
+    }
+    return states;
+}
+
+glob::States glob::step(const Compiled& pat, const States& states, const string& name) {
+    States next;
+    auto add = [&](u32 s) {
+        if (std::find(next.begin(), next.end(), s) == next.end()) next.push_back(s);
+    };
+
+    for (u32 s : states) {
+        if (s >= pat.segments.size()) continue;
+        const Segment& seg = pat.segments[s];
+
+        if (seg.globstar) add(s); // swallow this segment, stay
+        else if (seg.literal ? name == seg.text : match_segment(name, seg.text)) add(s + 1);
+    }
+    return closure(pat, std::move(next));
+}
+
+bool glob::accepts(const Compiled& pat, const States& states) {
+    return std::find(states.begin(), states.end(), (u32)pat.segments.size()) != states.end();
+}
+
+bool glob::excludes_subtree(const Compiled& pat, const States& states) {
+    // sitting on a trailing "**": everything below matches, no need to look
+    u32 last = (u32)pat.segments.size() - 1;
+    return pat.segments[last].globstar && std::find(states.begin(), states.end(), last) != states.end();
+}
+
+// ----- walking
+void glob::walk(Walk& plan, WalkTask task) {
+    FsSnapshot::Listing listing = FsSnapshot::list(task.dir);
+    if (!listing) {
         LOGFMT(
             PROJNAME,
             "file/globber",
             RED_TEXT("GLOB error:\t"),
-            e.what(), "\n"
+            "cannot list directory ", task.dir, "\n"
         );
+        return;
     }
-}
 
-bool glob::matches(const string& text, const string& pattern) {
-    // exact match
-    if (text == pattern) return true;
+    const usize set_count = plan.results.size();
+    vector<std::pair<u32, string>> found;
+
+    vector<char> file_excluded(set_count), tree_excluded(set_count);
+    for (const auto& entry : *listing) {
+        if (!entry.is_dir && !entry.is_file) continue;
+
+        string child = join(task.dir, entry.name);
+
+        // excludes move along whether or not their set's includes are active yet
+        vector<States> next_excludes(plan.excludes.size());
+        std::fill(file_excluded.begin(), file_excluded.end(), 0);
+        std::fill(tree_excluded.begin(), tree_excluded.end(), 0);
 
-    // wildcard handler (*)
-    if (pattern.size() > 1 && pattern[0] == '*') {
-        std::string suffix = pattern.substr(1);
-        if (text.length() >= suffix.length()) {
-            return (0 == text.compare(text.length() - suffix.length(), suffix.length(), suffix));
+        for (usize e = 0; e < plan.excludes.size(); e++) {
+            if (task.exclude_states[e].empty()) continue;
+
+            const Compiled& exclude = plan.excludes[e];
+            next_excludes[e] = step(exclude, task.exclude_states[e], entry.name);
+
+            if (entry.is_dir && excludes_subtree(exclude, next_excludes[e])) tree_excluded[plan.exclude_set[e]] = 1;
+            if (entry.is_file && accepts(exclude, next_excludes[e])) file_excluded[plan.exclude_set[e]] = 1;
         }
+
+        if (entry.is_file) {
+            // each file goes to every set that wants it
+            for (const auto& [i, states] : task.active) {
+                u32 set = plan.include_set[i];
+                if (file_excluded[set]) continue;
+
+                if (accepts(plan.includes[i], step(plan.includes[i], states, entry.name))) {
+                    found.emplace_back(set, stdfs::absolute(child).lexically_normal().string());
+                }
+            }
+            continue;
+        }
+
+        WalkTask sub;
+        for (const auto& [i, states] : task.active) {
+            if (tree_excluded[plan.include_set[i]]) continue;
+
+            States next = step(plan.includes[i], states, entry.name);
+            if (!next.empty()) sub.active.emplace_back(i, std::move(next)); // else prune
+        }
+
+        // patterns rooted here start now
+        auto nested = plan.nested_roots.find(child);
+        if (nested != plan.nested_roots.end()) {
+            {
+                std::lock_guard<std::mutex> lock(plan.results_mutex);
+                plan.reached.insert(child);
+            }
+            for (u32 i : nested->second) {
+                if (tree_excluded[plan.include_set[i]]) continue;
+                sub.active.emplace_back(i, closure(plan.includes[i], {plan.includes[i].root_len}));
+            }
+        }
+
+        if (sub.active.empty() && !plan.on_the_way.count(child)) continue;
+
+        sub.dir            = std::move(child);
+        sub.exclude_states = std::move(next_excludes);
+        plan.pool->add_task([&plan, sub = std::move(sub)]() mutable { walk(plan, std::move(sub)); });
     }
-    return false;
+
+    if (found.empty() && !plan.watched) return;
+
+    std::lock_guard<std::mutex> lock(plan.results_mutex);
+    if (plan.watched) plan.watched->push_back(task.dir);
+    for (auto& [set, path] : found) plan.results[set].push_back(std::move(path));
 }
 
-} // namespace ymk::fs
\ No newline at end of file
+} // namespace ymk::fs
@@ -0,0 +1,442 @@
+#include <core/http.h>
+#include <core/mt.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#ifndef IPLATFORM_WINDOWS
+    #include <sys/socket.h>
+    #include <sys/time.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <arpa/inet.h>
+    #include <poll.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cerrno>
+#else
+    #define WIN32_LEAN_AND_MEAN
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#endif
+
+namespace ymk {
+
+// ----- sockets
+#ifndef IPLATFORM_WINDOWS
+using socket_t = int;
+static constexpr socket_t BAD_SOCKET = -1;
+
+static void close_socket(socket_t s) { ::close(s); }
+
+#ifdef MSG_NOSIGNAL
+static constexpr i32 SEND_FLAGS = MSG_NOSIGNAL; // a dropped peer is an error, not a SIGPIPE
+#else
+static constexpr i32 SEND_FLAGS = 0;
+#endif
+
+#else
+using socket_t = SOCKET;
+static constexpr socket_t BAD_SOCKET = INVALID_SOCKET;
+
+static void close_socket(socket_t s) { closesocket(s); }
+static constexpr i32 SEND_FLAGS = 0;
+#endif
+
+static void net_init() {
+#ifdef IPLATFORM_WINDOWS
+    static std::once_flag once;
+    std::call_once(once, [] {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+    });
+#endif
+}
+
+static void set_options(socket_t s, i32 timeout_ms) {
+#ifndef IPLATFORM_WINDOWS
+    timeval tv;
+    tv.tv_sec  = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    #ifdef SO_NOSIGPIPE
+    i32 no_sigpipe = 1;
+    setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+    #endif
+#else
+    DWORD ms = (DWORD)timeout_ms;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&ms, sizeof(ms));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&ms, sizeof(ms));
+#endif
+
+    // small requests back to back, don't let nagle hold them
+    i32 one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+}
+
+static void set_blocking(socket_t s, bool blocking) {
+#ifndef IPLATFORM_WINDOWS
+    i32 flags = fcntl(s, F_GETFL, 0);
+    fcntl(s, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+#else
+    u_long mode = blocking ? 0 : 1;
+    ioctlsocket(s, FIONBIO, &mode);
+#endif
+}
+
+// connect with a timeout, an unreachable cache shouldn't stall the build for minutes
+static socket_t connect_to(const string& host, u16 port, i32 timeout_ms) {
+    net_init();
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) return BAD_SOCKET;
+
+    socket_t result = BAD_SOCKET;
+    for (addrinfo* ai = found; ai && result == BAD_SOCKET; ai = ai->ai_next) {
+        socket_t s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s == BAD_SOCKET) continue;
+
+        set_blocking(s, false);
+        bool ok = ::connect(s, ai->ai_addr, (i32)ai->ai_addrlen) == 0;
+        if (!ok) {
+#ifndef IPLATFORM_WINDOWS
+            pollfd pfd{s, POLLOUT, 0};
+            bool in_progress = errno == EINPROGRESS;
+            ok = in_progress && poll(&pfd, 1, timeout_ms) == 1;
+#else
+            WSAPOLLFD pfd{s, POLLOUT, 0};
+            bool in_progress = WSAGetLastError() == WSAEWOULDBLOCK;
+            ok = in_progress && WSAPoll(&pfd, 1, timeout_ms) == 1;
+#endif
+            i32 err = 0;
+            socklen_t len = sizeof(err);
+            ok = ok && getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&err, &len) == 0 && err == 0;
+        }
+
+        if (!ok) {
+            close_socket(s);
+            continue;
+        }
+
+        set_blocking(s, true);
+        set_options(s, timeout_ms);
+        result = s;
+    }
+
+    freeaddrinfo(found);
+    return result;
+}
+
+static bool send_all(socket_t s, const char* data, usize size) {
+    while (size > 0) {
+        i32 chunk = (i32)std::min<usize>(size, 1 << 20);
+        auto sent = send(s, data, chunk, SEND_FLAGS);
+        if (sent <= 0) return false;
+        data += sent;
+        size -= (usize)sent;
+    }
+    return true;
+}
+
+static bool read_more(socket_t s, string& pending) {
+    char buf[64 * 1024];
+    auto got = recv(s, buf, sizeof(buf), 0);
+    if (got <= 0) return false; // closed, timed out or failed
+    pending.append(buf, (usize)got);
+    return true;
+}
+
+// ----- message parsing, shared by client and server
+struct Head {
+    string first_line;
+    i64 content_length = -1;
+    bool chunked        = false;
+    bool close          = false;
+    bool expect_continue = false;
+};
+
+static string lower(string s) {
+    for (auto& c : s) c = (char)tolower((unsigned char)c);
+    return s;
+}
+
+static bool read_head(socket_t s, string& pending, Head& head) {
+    usize end;
+    while ((end = pending.find("\r\n\r\n")) == string::npos) {
+        if (pending.size() > 64 * 1024 || !read_more(s, pending)) return false;
+    }
+
+    string text = pending.substr(0, end);
+    pending.erase(0, end + 4);
+
+    usize line_end = text.find("\r\n");
+    head.first_line = text.substr(0, line_end);
+
+    while (line_end != string::npos) {
+        usize start = line_end + 2;
+        line_end    = text.find("\r\n", start);
+        string line = text.substr(start, line_end == string::npos ? string::npos : line_end - start);
+
+        usize colon = line.find(':');
+        if (colon == string::npos) continue;
+
+        string name  = lower(line.substr(0, colon));
+        string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+
+        if (name == "content-length") head.content_length = std::strtoll(value.c_str(), nullptr, 10);
+        else if (name == "transfer-encoding") head.chunked = lower(value).find("chunked") != string::npos;
+        else if (name == "connection") head.close = lower(value).find("close") != string::npos;
+        else if (name == "expect") head.expect_continue = lower(value).find("100-continue") != string::npos;
+    }
+    return true;
+}
+
+static bool read_exact(socket_t s, string& pending, usize size, string& out) {
+    while (pending.size() < size) {
+        if (!read_more(s, pending)) return false;
+    }
+    out.append(pending, 0, size);
+    pending.erase(0, size);
+    return true;
+}
+
+static bool read_line(socket_t s, string& pending, string& line) {
+    usize end;
+    while ((end = pending.find("\r\n")) == string::npos) {
+        if (pending.size() > 4096 || !read_more(s, pending)) return false;
+    }
+    line = pending.substr(0, end);
+    pending.erase(0, end + 2);
+    return true;
+}
+
+static bool read_body(socket_t s, string& pending, const Head& head, usize limit, string& out) {
+    out.clear();
+
+    if (head.chunked) {
+        string line;
+        while (true) {
+            if (!read_line(s, pending, line)) return false;
+
+            usize size = (usize)std::strtoull(line.c_str(), nullptr, 16);
+            if (size == 0) break;
+            if (out.size() + size > limit) return false;
+
+            string crlf;
+            if (!read_exact(s, pending, size, out) || !read_exact(s, pending, 2, crlf)) return false;
+        }
+
+        // trailers up to the empty line
+        do {
+            if (!read_line(s, pending, line)) return false;
+        } while (!line.empty());
+        return true;
+    }
+
+    if (head.content_length >= 0) {
+        if ((usize)head.content_length > limit) return false;
+        return read_exact(s, pending, (usize)head.content_length, out);
+    }
+
+    return false; // the caller decides what a body without a length means
+}
+
+// ----- Url
+bool Url::parse(const string& text, Url& out) {
+    const string scheme = "http://";
+    if (text.compare(0, scheme.size(), scheme) != 0) return false;
+
+    string rest  = text.substr(scheme.size());
+    usize slash  = rest.find('/');
+    string authority = rest.substr(0, slash);
+    out.prefix = slash == string::npos ? "" : rest.substr(slash);
+    while (!out.prefix.empty() && out.prefix.back() == '/') out.prefix.pop_back();
+
+    // host:port, [v6]:port
+    usize colon   = authority.rfind(':');
+    usize bracket = authority.rfind(']');
+    bool has_port = colon != string::npos &&
+                    (bracket == string::npos ? authority.find(':') == colon : colon > bracket);
+
+    if (has_port) {
+        out.host = authority.substr(0, colon);
+        long port = std::strtol(authority.c_str() + colon + 1, nullptr, 10);
+        if (port <= 0 || port > 65535) return false;
+        out.port = (u16)port;
+    } else {
+        out.host = authority;
+        out.port = 80;
+    }
+
+    // [::1] -> ::1 for getaddrinfo
+    if (out.host.size() > 2 && out.host.front() == '[' && out.host.back() == ']') {
+        out.host = out.host.substr(1, out.host.size() - 2);
+    }
+    return !out.host.empty();
+}
+
+// ----- HttpConnection
+bool HttpConnection::connect(const Url& url) {
+    close();
+    socket_t s = connect_to(url.host, url.port, TIMEOUT_MS);
+    if (s == BAD_SOCKET) return false;
+    sock = (i64)s;
+    return true;
+}
+
+void HttpConnection::close() {
+    if (sock != -1) close_socket((socket_t)sock);
+    sock = -1;
+    pending.clear();
+}
+
+i32 HttpConnection::request(const string& method, const string& host, const string& path, const string& body, string* response_body) {
+    if (!is_open()) return 0;
+    socket_t s = (socket_t)sock;
+
+    string head = method + " " + path + " HTTP/1.1\r\nHost: " + host + "\r\n";
+    if (method == "PUT" || !body.empty()) head += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    head += "\r\n";
+
+    if (!send_all(s, head.data(), head.size()) || !send_all(s, body.data(), body.size())) {
+        close();
+        return 0;
+    }
+
+    Head reply;
+    if (!read_head(s, pending, reply)) {
+        close();
+        return 0;
+    }
+
+    // "HTTP/1.1 200 OK"
+    usize space = reply.first_line.find(' ');
+    i32 status  = space == string::npos ? 0 : std::atoi(reply.first_line.c_str() + space + 1);
+    if (status <= 0) {
+        close();
+        return 0;
+    }
+
+    string content;
+    bool no_body = method == "HEAD" || status == 204 || status == 304 || status < 200;
+    if (!no_body) {
+        bool ok;
+        if (reply.chunked || reply.content_length >= 0) {
+            ok = read_body(s, pending, reply, HttpServer::MAX_BODY, content);
+        } else {
+            // no length: the body runs until the server closes
+            while (read_more(s, pending)) {}
+            content.swap(pending);
+            reply.close = true;
+            ok = true;
+        }
+
+        if (!ok) {
+            close();
+            return 0;
+        }
+    }
+
+    if (response_body) response_body->swap(content);
+    if (reply.close) close();
+    return status;
+}
+
+// ----- HttpServer
+static const char* reason(i32 status) {
+    switch (status) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        default:  return "Internal Server Error";
+    }
+}
+
+static void serve_connection(socket_t s, const HttpServer::Handler& handler) {
+    string pending;
+    while (true) {
+        Head head;
+        if (!read_head(s, pending, head)) break;
+
+        // "PUT /path HTTP/1.1"
+        usize first  = head.first_line.find(' ');
+        usize second = head.first_line.find(' ', first + 1);
+        if (first == string::npos || second == string::npos) break;
+
+        string method = head.first_line.substr(0, first);
+        string path   = head.first_line.substr(first + 1, second - first - 1);
+
+        if (head.expect_continue) {
+            const string go = "HTTP/1.1 100 Continue\r\n\r\n";
+            if (!send_all(s, go.data(), go.size())) break;
+        }
+
+        string body;
+        i32 status = 0;
+        bool has_body = head.chunked || head.content_length > 0;
+        if (has_body && !read_body(s, pending, head, HttpServer::MAX_BODY, body)) {
+            status = 413; // or a broken body, the connection is closed either way
+            head.close = true;
+        }
+
+        string response;
+        if (status == 0) status = handler(method, path, body, response);
+
+        string reply = "HTTP/1.1 " + std::to_string(status) + " " + reason(status) + "\r\n" +
+                       "Content-Length: " + std::to_string(response.size()) + "\r\n";
+        if (head.close) reply += "Connection: close\r\n";
+        reply += "\r\n";
+        if (method != "HEAD") reply += response;
+
+        if (!send_all(s, reply.data(), reply.size()) || head.close) break;
+    }
+    close_socket(s);
+}
+
+bool HttpServer::serve(const string& bind_address, u16 port, usize threads, const Handler& handler) {
+    net_init();
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (inet_pton(AF_INET, bind_address.c_str(), &addr.sin_addr) != 1) return false;
+
+    socket_t listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener == BAD_SOCKET) return false;
+
+    i32 one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 128) != 0) {
+        close_socket(listener);
+        return false;
+    }
+
+    // idle keep-alive connections give their thread back after a while
+    ThreadPool pool(threads);
+    while (true) {
+        socket_t client = accept(listener, nullptr, nullptr);
+        if (client == BAD_SOCKET) continue;
+
+        set_options(client, 5000);
+        pool.add_task([client, &handler] { serve_connection(client, handler); });
+    }
+}
+
+} // namespace ymk
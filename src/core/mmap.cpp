@@ -0,0 +1,95 @@
+#include <core/mmap.h>
+
+#ifndef IPLATFORM_WINDOWS
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#else
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#endif
+
+namespace ymk {
+
+#ifndef IPLATFORM_WINDOWS
+
+bool MappedFile::open(const string& path) {
+    close();
+
+    i32 fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mem = mmap(nullptr, (usize)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+
+    if (mem == MAP_FAILED) return false;
+
+    ptr = (const unsigned char*)mem;
+    len = (usize)st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (ptr) munmap((void*)ptr, len);
+    ptr = nullptr;
+    len = 0;
+}
+
+#else
+
+bool MappedFile::open(const string& path) {
+    close();
+
+    HANDLE file = CreateFileA(
+        path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* mem = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!mem) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    ptr            = (const unsigned char*)mem;
+    len            = (usize)size.QuadPart;
+    file_handle    = file;
+    mapping_handle = mapping;
+    return true;
+}
+
+void MappedFile::close() {
+    if (ptr) UnmapViewOfFile(ptr);
+    if (mapping_handle) CloseHandle((HANDLE)mapping_handle);
+    if (file_handle) CloseHandle((HANDLE)file_handle);
+
+    ptr            = nullptr;
+    len            = 0;
+    file_handle    = nullptr;
+    mapping_handle = nullptr;
+}
+
+#endif
+
+} // namespace ymk
@@ -0,0 +1,140 @@
+#include <core/process.h>
+#include <logger.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef IPLATFORM_WINDOWS
+    #include <spawn.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cerrno>
+    #include <sys/wait.h>
+    #include <sys/resource.h>
+
+extern char **environ;
+#endif
+
+namespace ymk {
+
+#ifndef IPLATFORM_WINDOWS
+
+static bool open_pipe(i32 fds[2]) {
+#if defined(__linux__)
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+ProcessResult Process::run(const CompileCmd& cmd, const ProcessOptions& opts) {
+    ProcessResult res;
+
+    // argv points into cmd, which outlives the spawn call
+    vector<char*> argv;
+    argv.reserve(cmd.arg_count() + 2);
+    argv.push_back(const_cast<char*>(cmd.program.c_str()));
+    cmd.for_each_arg([&](const string& arg) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    });
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    // close-on-exec, so children spawned by other jobs don't hold our write end open
+    i32 pipe_fds[2] = {-1, -1};
+    if (opts.on_stdout) {
+        if (!open_pipe(pipe_fds)) {
+            posix_spawn_file_actions_destroy(&actions);
+            return res;
+        }
+        posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    } else if (!opts.stdout_path.empty()) {
+        posix_spawn_file_actions_addopen(
+            &actions, STDOUT_FILENO, opts.stdout_path.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC, 0644
+        );
+    }
+
+    pid_t pid;
+    i32 err = posix_spawnp(&pid, cmd.program.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (opts.on_stdout) {
+        close(pipe_fds[1]);
+
+        // drain even if spawning failed, that just reads EOF
+        vector<char> chunk(PIPE_CHUNK);
+        while (err == 0) {
+            ssize_t n = read(pipe_fds[0], chunk.data(), chunk.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            opts.on_stdout(chunk.data(), (usize)n);
+        }
+        close(pipe_fds[0]);
+    }
+
+    if (err != 0) {
+        LOGFMT(
+            PROJNAME,
+            "process",
+            RED_TEXT("[ERROR]: "), "couldn't start '", cmd.program, "': ", strerror(err), "\n"
+        );
+        return res;
+    }
+    res.spawned = true;
+
+    i32 status = 0;
+    struct rusage usage = {};
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) return res;
+    }
+
+    if (WIFEXITED(status)) res.exit_code = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status)) res.signal = WTERMSIG(status);
+
+    res.user_sec   = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    res.sys_sec    = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    res.max_rss_kb = usage.ru_maxrss;
+
+    return res;
+}
+
+#else
+
+ProcessResult Process::run(const CompileCmd& cmd, const ProcessOptions& opts) {
+    // NOTE: CreateProcess port pending, goes through the shell for now
+    string full_cmd = cmd.to_string();
+    ProcessResult res;
+    res.spawned = true;
+
+    if (opts.on_stdout) {
+        FILE* pipe = _popen(full_cmd.c_str(), "rb");
+        if (!pipe) {
+            res.spawned = false;
+            return res;
+        }
+
+        vector<char> chunk(PIPE_CHUNK);
+        usize n;
+        while ((n = fread(chunk.data(), 1, chunk.size(), pipe)) > 0) {
+            opts.on_stdout(chunk.data(), n);
+        }
+        res.exit_code = _pclose(pipe);
+        return res;
+    }
+
+    if (!opts.stdout_path.empty()) full_cmd += " > \"" + opts.stdout_path + "\"";
+
+    res.exit_code = std::system(full_cmd.c_str());
+    return res;
+}
+
+#endif
+
+} // namespace ymk
@@ -0,0 +1,268 @@
+#include <core/snapshot.h>
+
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef __linux__
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cstring>
+#endif
+
+namespace stdfs = std::filesystem;
+
+namespace ymk {
+
+namespace {
+
+struct Entry {
+    FileStamp stamp;
+    bool is_dir = false;
+};
+
+// everything known about one directory: its children's stats and its listing.
+// invalidate() bumps the generation, a stat or listing racing with it isn't kept
+struct DirNode {
+    std::mutex mutex;
+    std::unordered_map<string, Entry> entries;
+    FsSnapshot::Listing listing;
+    u64 generation = 0;
+};
+
+// sharded by directory, the compile workers hit it all at once
+struct Shard {
+    std::mutex mutex;
+    std::unordered_map<string, std::shared_ptr<DirNode>> dirs;
+};
+
+constexpr usize SHARD_COUNT = 32;
+Shard shards[SHARD_COUNT];
+
+string strip_slash(const string& path) {
+    string p = path;
+    while (p.size() > 1 && (p.back() == '/' || p.back() == '\\')) p.pop_back();
+    return p;
+}
+
+// "a/b/c.h" -> {"a/b", "c.h"}, "c.h" -> {".", "c.h"}
+std::pair<string, string> split(const string& path) {
+    string p = strip_slash(path);
+    size_t slash = p.find_last_of("/\\");
+    if (slash == string::npos) return {".", p};
+    if (slash == 0) return {"/", p.substr(1)};
+    return {p.substr(0, slash), p.substr(slash + 1)};
+}
+
+Shard& shard_of(const string& dir) {
+    return shards[std::hash<string>{}(dir) % SHARD_COUNT];
+}
+
+std::shared_ptr<DirNode> node_of(const string& dir) {
+    Shard& shard = shard_of(dir);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto& node = shard.dirs[dir];
+    if (!node) node = std::make_shared<DirNode>();
+    return node;
+}
+
+void drop_node(const string& dir) {
+    Shard& shard = shard_of(dir);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.dirs.erase(dir);
+}
+
+Entry lookup(const string& path) {
+    auto [dir, name] = split(path);
+    auto node = node_of(dir);
+    u64 generation;
+    {
+        std::lock_guard<std::mutex> lock(node->mutex);
+        auto it = node->entries.find(name);
+        if (it != node->entries.end()) return it->second;
+        generation = node->generation;
+    }
+
+    // syscall outside the lock, two threads may both stat, both get the same answer
+    Entry entry;
+    entry.stamp = FileStat::get(path, &entry.is_dir);
+
+    std::lock_guard<std::mutex> lock(node->mutex);
+    if (node->generation == generation) node->entries.emplace(name, entry);
+    return entry;
+}
+
+} // namespace
+
+FileStamp FsSnapshot::stat(const string& path) {
+    return lookup(path).stamp;
+}
+
+bool FsSnapshot::is_dir(const string& path) {
+    Entry entry = lookup(path);
+    return entry.stamp.exists && entry.is_dir;
+}
+
+bool FsSnapshot::is_file(const string& path) {
+    Entry entry = lookup(path);
+    return entry.stamp.exists && !entry.is_dir;
+}
+
+bool FsSnapshot::known(const string& path) {
+    auto [dir, name] = split(path);
+    auto node = node_of(dir);
+
+    std::lock_guard<std::mutex> lock(node->mutex);
+    return node->entries.count(name) != 0;
+}
+
+void FsSnapshot::insert(const string& path, const FileStamp& stamp, bool is_dir) {
+    auto [dir, name] = split(path);
+    auto node = node_of(dir);
+
+    std::lock_guard<std::mutex> lock(node->mutex);
+    node->entries.emplace(name, Entry{stamp, is_dir});
+}
+
+// ----- listing
+#ifdef __linux__
+
+// layout getdents64 fills in, glibc doesn't export it
+struct linux_dirent64 {
+    u64 d_ino;
+    i64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// raw getdents64 into a big buffer: a few syscalls per directory instead of
+// one per entry, and d_type saves a stat for nearly everything
+static bool read_dir(const string& dir, vector<FsSnapshot::DirEntry>& out) {
+    i32 fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    alignas(linux_dirent64) char buf[64 * 1024];
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n < 0) {
+            close(fd);
+            return false;
+        }
+        if (n == 0) break;
+
+        for (long pos = 0; pos < n;) {
+            auto* d = (linux_dirent64*)(buf + pos);
+            pos += d->d_reclen;
+
+            const char* name = d->d_name;
+            if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+
+            FsSnapshot::DirEntry entry{name, d->d_type == DT_DIR, d->d_type == DT_REG};
+
+            // filesystem didn't say, or a symlink: ask about the target.
+            // symlinked directories aren't descended into (no cycles)
+            if (d->d_type == DT_UNKNOWN || d->d_type == DT_LNK) {
+                struct stat st;
+                if (fstatat(fd, name, &st, 0) == 0) {
+                    entry.is_dir  = d->d_type == DT_UNKNOWN && S_ISDIR(st.st_mode);
+                    entry.is_file = S_ISREG(st.st_mode);
+                }
+            }
+            out.push_back(std::move(entry));
+        }
+    }
+
+    close(fd);
+    return true;
+}
+
+#else
+
+// d_type from the listing itself, no stat per entry where the platform has it
+static bool read_dir(const string& dir, vector<FsSnapshot::DirEntry>& out) {
+    std::error_code ec;
+    stdfs::directory_iterator it(dir, ec);
+    if (ec) return false;
+
+    for (; it != stdfs::directory_iterator(); it.increment(ec)) {
+        if (ec) return false;
+
+        // symlinked directories aren't descended into (no cycles), same as recursive_directory_iterator
+        std::error_code type_ec;
+        out.push_back({
+            it->path().filename().string(),
+            it->is_directory(type_ec) && !it->is_symlink(type_ec),
+            it->is_regular_file(type_ec)
+        });
+    }
+    return true;
+}
+
+#endif
+
+FsSnapshot::Listing FsSnapshot::list(const string& dir) {
+    string key = strip_slash(dir);
+    auto node = node_of(key);
+    u64 generation;
+    {
+        std::lock_guard<std::mutex> lock(node->mutex);
+        if (node->listing) return node->listing;
+        generation = node->generation;
+    }
+
+    auto entries = std::make_shared<vector<DirEntry>>();
+    if (!read_dir(key, *entries)) return nullptr;
+
+    std::lock_guard<std::mutex> lock(node->mutex);
+    if (node->generation != generation) return entries;
+    if (!node->listing) node->listing = std::move(entries);
+    return node->listing;
+}
+
+void FsSnapshot::insert_listing(const string& dir, Listing listing) {
+    auto node = node_of(strip_slash(dir));
+
+    std::lock_guard<std::mutex> lock(node->mutex);
+    if (!node->listing) node->listing = std::move(listing);
+}
+
+void FsSnapshot::invalidate(const string& path) {
+    string p = strip_slash(path);
+    auto [dir, name] = split(p);
+    {
+        auto node = node_of(dir);
+        std::lock_guard<std::mutex> lock(node->mutex);
+        node->entries.erase(name);
+        node->listing = nullptr;
+        node->generation++;
+    }
+    drop_node(p); // in case it's a directory
+}
+
+bool FsSnapshot::create_directories(const string& dir) {
+    if (is_dir(dir)) return true;
+
+    std::error_code ec;
+    stdfs::create_directories(dir, ec);
+
+    // every missing parent was created too, their listings are stale
+    for (stdfs::path p = stdfs::path(strip_slash(dir)); !p.empty(); p = p.parent_path()) {
+        invalidate(p.string());
+        if (p == p.parent_path()) break;
+    }
+    return !ec;
+}
+
+void FsSnapshot::reset() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.dirs.clear();
+    }
+}
+
+} // namespace ymk
@@ -0,0 +1,72 @@
+#include <core/stat.h>
+
+#ifndef IPLATFORM_WINDOWS
+    #include <sys/stat.h>
+    #include <chrono>
+#else
+    #include <filesystem>
+#endif
+
+namespace ymk {
+
+#ifndef IPLATFORM_WINDOWS
+
+FileStamp FileStat::get(const string& path, bool* is_dir) {
+    FileStamp stamp;
+    if (is_dir) *is_dir = false;
+
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return stamp;
+    if (is_dir) *is_dir = S_ISDIR(st.st_mode);
+
+#if defined(__APPLE__)
+    const struct timespec& mt = st.st_mtimespec;
+#else
+    const struct timespec& mt = st.st_mtim;
+#endif
+
+    stamp.exists   = true;
+    stamp.mtime_ns = (u64)mt.tv_sec * 1000000000ull + (u64)mt.tv_nsec;
+    stamp.size     = (u64)st.st_size;
+    stamp.inode    = (u64)st.st_ino;
+    return stamp;
+}
+
+u64 FileStat::now_ns() {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+#else
+
+FileStamp FileStat::get(const string& path, bool* is_dir) {
+    namespace stdfs = std::filesystem;
+
+    FileStamp stamp;
+    std::error_code ec;
+    bool dir = stdfs::is_directory(path, ec);
+    if (is_dir) *is_dir = dir;
+
+    auto mtime = stdfs::last_write_time(path, ec);
+    if (ec) return stamp;
+    u64 size = dir ? 0 : stdfs::file_size(path, ec);
+    if (ec) return stamp;
+
+    // file_time_type ticks are 100ns on windows
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch());
+
+    stamp.exists   = true;
+    stamp.mtime_ns = (u64)ns.count();
+    stamp.size     = size;
+    return stamp;
+}
+
+u64 FileStat::now_ns() {
+    // last_write_time's clock, its epoch isn't the unix one
+    auto now = std::filesystem::file_time_type::clock::now().time_since_epoch();
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+#endif
+
+} // namespace ymk
@@ -1,7 +1,13 @@
 #include <core/toolchain.h>
+#include <build/hash.h>
+#include <logger.h>
 
 #include <sstream>
+#include <fstream>
 #include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <unordered_set>
 
 using std::stringstream;
 
@@ -13,13 +19,13 @@ string CompileCmd::to_string() const {
     stringstream ss;
 
     ss << program;
-    for(const auto &arg : args) {
+    for_each_arg([&](const string &arg) {
         if (arg.find(' ') != string::npos) {
             ss << " \"" << arg << "\"";
         } else {
             ss << ' ' << arg;
         }
-    }
+    });
 
     return ss.str();
 }
@@ -33,6 +39,21 @@ static string to_lower(string s) {
     return s;
 }
 
+// extension with the dot (".cpp"), empty if there is none
+static string file_ext(const string& path) {
+    size_t dot   = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == string::npos || (slash != string::npos && dot < slash)) return "";
+    return path.substr(dot);
+}
+
+// gcc/clang go by case (".C" is C++), cl.exe doesn't
+static bool is_c_source(CompilerType type, const string& path) {
+    string ext = file_ext(path);
+    if (type == CompilerType::MSVC) ext = to_lower(ext);
+    return ext == ".c";
+}
+
 // -------------- toolchain ---------------
 
 CompilerType Toolchain::detect(const string& cmd) {
@@ -81,59 +102,97 @@ static void add_common_flags(vector<string>& args, CompilerType type, const Conf
         if (type == CompilerType::MSVC) args.push_back("/O" + level); // /O2
         else args.push_back("-O" + level); // -O3
     }
+
+    // -------- workspace root, the output doesn't depend on where the checkout is
+    // (cl has no documented equivalent, its debug info keeps absolute paths)
+    if (config.path_root.has_value() && type != CompilerType::MSVC) {
+        args.push_back("-ffile-prefix-map=" + config.path_root.value() + "=.");
+
+        // gcc -E writes the working directory as a linemarker, prefix map or not
+        if (type == CompilerType::GCC) args.push_back("-fno-working-directory");
+    }
 }
 
 // --- implementation ---
-CompileCmd Toolchain::create_preprocess_cmd(const Project& proj, const Config& config, const string& src, const string& out) {
-    // We assume C++ for simplicity, but logic could check file extension
-    string compiler = config.compiler;
-    
-    CompilerType type = detect(compiler);
+CompileTemplate Toolchain::create_compile_template(const Project& proj, const Config& config) {
+    CompileTemplate tmpl;
+    tmpl.program = config.compiler;
+    tmpl.type    = detect(config.compiler);
+
+    auto flags = std::make_shared<vector<string>>();
+    add_common_flags(*flags, tmpl.type, config);
+
+    // for shared libs (DLLs/SOs), we need Position Independent Code on linux.
+    // preprocessing gets it too, -fPIC predefines __PIC__
+    if (proj.type == ArtifactType::SharedLib && tmpl.type != CompilerType::MSVC) {
+        flags->push_back("-fPIC");
+    }
+
+    tmpl.flags = std::move(flags);
+    return tmpl;
+}
+
+CompileCmd Toolchain::create_preprocess_cmd(const CompileTemplate& tmpl, const string& src, const string& out) {
     CompileCmd cmd;
-    cmd.program = compiler;
+    cmd.program     = tmpl.program;
+    cmd.shared_args = tmpl.flags;
+    cmd.args.reserve(4);
 
-    // preprocess flag
-    if (type == CompilerType::MSVC) cmd.args.push_back("/P"); 
+    // preprocess flag (msvc: /P writes a file, /E writes stdout)
+    if (tmpl.type == CompilerType::MSVC) cmd.args.push_back(out.empty() ? "/E" : "/P");
     else cmd.args.push_back("-E");
 
-    add_common_flags(cmd.args, type, config);
-
     cmd.args.push_back(src);
     
-    // output flag
-    if (type == CompilerType::MSVC)
-        cmd.args.push_back("/Fi" + out);
-    else {
-        cmd.args.push_back("-o");
-        cmd.args.push_back(out);
+    // output flag, none -> stdout
+    if (!out.empty()) {
+        if (tmpl.type == CompilerType::MSVC) {
+            cmd.args.push_back("/Fi" + out);
+        } else {
+            cmd.args.push_back("-o");
+            cmd.args.push_back(out);
+        }
     }
 
     return cmd;
 }
 
-CompileCmd Toolchain::create_compile_cmd(const Project& proj, const Config& config, const string& src, const string& out) {
-    string compiler = config.compiler;
-    CompilerType type = detect(compiler);
+CompileCmd Toolchain::create_compile_cmd(const CompileTemplate& tmpl, const string& src, const string& out, const string& preprocessed) {
+    CompilerType type = tmpl.type;
 
     CompileCmd cmd;
-    cmd.program = compiler;
+    cmd.program     = tmpl.program;
+    cmd.shared_args = tmpl.flags;
+    cmd.args.reserve(8);
 
     // compile only flag
     if (type == CompilerType::MSVC) cmd.args.push_back("/c");
     else cmd.args.push_back("-c");
 
-    add_common_flags(cmd.args, type, config);
-    
-    // for shared libs (DLLs/SOs), we need Position Independent Code on linux
-    if (proj.type == ArtifactType::SharedLib && type != CompilerType::MSVC) {
-        cmd.args.push_back("-fPIC");
+    if (preprocessed.empty()) {
+        cmd.args.push_back(src);
+    } else {
+        // already preprocessed, tell the compiler so it skips that stage
+        bool is_c = is_c_source(type, src);
+        if (type == CompilerType::MSVC) {
+            cmd.args.push_back((is_c ? "/Tc" : "/Tp") + preprocessed);
+        } else {
+            cmd.args.push_back("-x");
+            cmd.args.push_back(is_c ? "cpp-output" : "c++-cpp-output");
+            cmd.args.push_back(preprocessed);
+        }
     }
 
-    cmd.args.push_back(src);
-
-    // Add this in create_link_cmd before the output flag logic
-    for (const auto& flag : config.flags) {
-        cmd.args.push_back(flag);
+    // header dependencies as a side effect of compiling
+    // (a preprocessed input has no #includes left, the cache reads its linemarkers instead)
+    if (preprocessed.empty()) {
+        if (type == CompilerType::MSVC) {
+            cmd.args.push_back("/showIncludes");
+        } else {
+            cmd.args.push_back("-MMD");
+            cmd.args.push_back("-MF");
+            cmd.args.push_back(depfile_path(out));
+        }
     }
 
     // output
@@ -189,4 +248,199 @@ CompileCmd Toolchain::create_link_cmd(const Project& proj, const Config& config,
     return cmd;
 }
 
+// ----- response files
+
+// gcc (libiberty): whitespace splits, '\' escapes anything, quotes group
+static void quote_gnu(string& out, const string& arg) {
+    if (!arg.empty() && arg.find_first_of(" \t\n\"'\\") == string::npos) {
+        out += arg;
+        return;
+    }
+
+    out += '"';
+    for (char c : arg) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    out += '"';
+}
+
+// msvc (CommandLineToArgvW): '\' is literal unless a run of them ends in '"'
+static void quote_windows(string& out, const string& arg) {
+    if (!arg.empty() && arg.find_first_of(" \t\n\"") == string::npos) {
+        out += arg;
+        return;
+    }
+
+    out += '"';
+    usize slashes = 0;
+    for (char c : arg) {
+        if (c == '\\') {
+            slashes++;
+            continue;
+        }
+
+        // backslashes before a quote are doubled, the quote escaped
+        out.append(c == '"' ? slashes * 2 + 1 : slashes, '\\');
+        slashes = 0;
+        out += c;
+    }
+    out.append(slashes * 2, '\\'); // they precede the closing quote
+    out += '"';
+}
+
+CompileCmd Toolchain::with_response_file(CompilerType type, const CompileCmd& cmd, const string& dir) {
+    usize shared_len = 0, own_len = 0;
+    if (cmd.shared_args) {
+        for (const auto& arg : *cmd.shared_args) shared_len += arg.size() + 1;
+    }
+    for (const auto& arg : cmd.args) own_len += arg.size() + 1;
+
+    usize total = cmd.program.size() + shared_len + own_len;
+    if (total <= RESPONSE_FILE_THRESHOLD) return cmd;
+
+    // "@" + dir + "/" + 32 hex + ".rsp"
+    usize rsp_arg_len = dir.size() + 38;
+    bool shared_only  = cmd.shared_args && cmd.program.size() + own_len + rsp_arg_len <= RESPONSE_FILE_THRESHOLD;
+
+    // clang picks the host's quoting, mingw gcc stays gnu
+#ifdef IPLATFORM_WINDOWS
+    bool windows_quoting = type == CompilerType::MSVC || type == CompilerType::Clang;
+#else
+    bool windows_quoting = type == CompilerType::MSVC;
+#endif
+
+    string content;
+    content.reserve(shared_len + (shared_only ? 0 : own_len) + 64);
+    auto add = [&](const string& arg) {
+        if (windows_quoting) quote_windows(content, arg);
+        else quote_gnu(content, arg);
+        content += '\n';
+    };
+    if (shared_only) {
+        for (const auto& arg : *cmd.shared_args) add(arg);
+    } else {
+        cmd.for_each_arg(add);
+    }
+
+    string path = dir + "/" + build::Hasher::of(content).to_hex() + ".rsp";
+
+    // every TU of a project asks for the same file, written once per run at most
+    static std::mutex written_mutex;
+    static std::unordered_set<string> written;
+    {
+        std::lock_guard<std::mutex> lock(written_mutex);
+        if (!written.count(path)) {
+            std::ifstream existing(path, std::ios::binary);
+            if (!existing.is_open()) {
+                // written aside and renamed in, a compiler never reads half a file
+                string tmp = path + ".tmp";
+                std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+                out.write(content.data(), (std::streamsize)content.size());
+                out.close();
+
+                // another build may have renamed the same content in first
+                bool placed = out.good() && (std::rename(tmp.c_str(), path.c_str()) == 0 || std::ifstream(path).is_open());
+                if (!placed) {
+                    std::remove(tmp.c_str());
+                    LOGFMT(PROJNAME, "toolchain", YELLOW_TEXT("[WARN]: "), "Cannot write response file ", path, ", passing ", total, " chars as is\n");
+                    return cmd;
+                }
+            }
+            written.insert(path);
+        }
+    }
+
+    CompileCmd out;
+    out.program = cmd.program;
+    out.args.reserve(shared_only ? cmd.args.size() + 1 : 1);
+    out.args.push_back("@" + path);
+    if (shared_only) out.args.insert(out.args.end(), cmd.args.begin(), cmd.args.end());
+    return out;
+}
+
+string Toolchain::depfile_path(const string& obj) {
+    return obj + ".d";
+}
+
+// make syntax: "obj.o: src.cpp a.h \<newline> dir\ x/b.h", with '\ ' / '$$' escapes
+static vector<string> parse_make_deps(const string& text) {
+    vector<string> deps;
+
+    // skip the target, it ends at the first ':' followed by whitespace (not "C:\")
+    size_t i = 0;
+    while (i < text.size()) {
+        if (text[i] == ':' && (i + 1 == text.size() || isspace((unsigned char)text[i + 1]))) break;
+        i++;
+    }
+    i++;
+
+    string cur;
+    for (; i < text.size(); i++) {
+        char c = text[i];
+
+        if (c == '\\' && i + 1 < text.size()) {
+            char n = text[i + 1];
+            // line continuation (backslash + \n or \r\n)
+            if (n == '\n') { i++; continue; }
+            if (n == '\r') { i += (i + 2 < text.size() && text[i + 2] == '\n') ? 2 : 1; continue; }
+
+            // escaped space/hash, other backslashes are path separators on windows
+            if (n == ' ' || n == '#') { cur += n; i++; continue; }
+        }
+        if (c == '$' && i + 1 < text.size() && text[i + 1] == '$') {
+            cur += '$';
+            i++;
+            continue;
+        }
+
+        if (isspace((unsigned char)c)) {
+            if (!cur.empty()) deps.push_back(std::move(cur));
+            cur.clear();
+
+            // -MP style phony targets start on a new line, we only want the first rule
+            if (c == '\n') break;
+            continue;
+        }
+
+        cur += c;
+    }
+    if (!cur.empty()) deps.push_back(std::move(cur));
+
+    return deps;
+}
+
+vector<string> Toolchain::read_depfile(CompilerType type, const string& depfile, const string& src, string* other_output) {
+    std::ifstream in(depfile, std::ios::binary);
+    if (!in.is_open()) return {};
+
+    vector<string> deps;
+
+    if (type == CompilerType::MSVC) {
+        // NOTE: the prefix is localized by cl.exe, english toolsets only for now
+        const string prefix = "Note: including file:";
+
+        string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+
+            if (line.compare(0, prefix.size(), prefix) != 0) {
+                if (other_output) *other_output += line + "\n";
+                continue;
+            }
+
+            // nested includes are indented, strip that
+            size_t start = line.find_first_not_of(' ', prefix.size());
+            if (start != string::npos) deps.push_back(line.substr(start));
+        }
+    } else {
+        stringstream ss;
+        ss << in.rdbuf();
+        deps = parse_make_deps(ss.str());
+    }
+
+    deps.erase(std::remove(deps.begin(), deps.end(), src), deps.end());
+    return deps;
+}
+
 }  // namespace ymk
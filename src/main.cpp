@@ -6,8 +6,11 @@
 #include <parser/parser.h>
 #include <core/toolchain.h>
 #include <build/builder.h>
+#include <build/cache_server.h>
+#include <core/http.h>
 #include <cli/cmd.h> 
 
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <filesystem>
@@ -52,6 +55,47 @@ void build_project(std::vector<std::string>& input, std::map<std::string, std::s
     std::string config_path = args.count("config") ? args["config"] : "build.ymk";
     std::string mode = args.count("mode") ? args["mode"] : "debug";
 
+    ymk::build::BuildOptions opts;
+    opts.compile_preprocessed = args.count("preprocessed") > 0;
+    opts.normalize_hash       = args.count("normalize") > 0;
+    opts.relative_paths       = args.count("relative") > 0;
+
+    // the store is per machine, not per project: flags or the environment, never build.ymk
+    const char* store_env      = std::getenv("YMK_STORE");
+    const char* store_size_env = std::getenv("YMK_STORE_SIZE");
+    if (args.count("store")) opts.store_dir = args["store"];
+    else if (store_env) opts.store_dir = store_env;
+
+    std::string store_size = args.count("store-size") ? args["store-size"] : (store_size_env ? store_size_env : "");
+    if (!store_size.empty() && !ymk::build::ObjectStore::parse_size(store_size, opts.store_size)) {
+        LOGFMT(PROJNAME, "build", RED_TEXT("[ERROR]: "), "Invalid store size: ", store_size, "\n");
+        return;
+    }
+
+    const char* remote_env = std::getenv("YMK_REMOTE");
+    const char* remote_ro  = std::getenv("YMK_REMOTE_READONLY");
+    if (args.count("remote")) opts.remote_url = args["remote"];
+    else if (remote_env) opts.remote_url = remote_env;
+    opts.remote_read_only = args.count("remote-readonly") > 0 || (remote_ro && std::string(remote_ro) != "0");
+
+    if (args.count("remote-jobs")) {
+        try {
+            opts.remote_transfers = std::stoul(args["remote-jobs"]);
+        } catch (const std::exception&) {
+            LOGFMT(PROJNAME, "build", RED_TEXT("[ERROR]: "), "Invalid transfer count: ", args["remote-jobs"], "\n");
+            return;
+        }
+    }
+
+    if (args.count("jobs")) {
+        try {
+            opts.jobs = std::stoul(args["jobs"]);
+        } catch (const std::exception&) {
+            LOGFMT(PROJNAME, "build", RED_TEXT("[ERROR]: "), "Invalid job count: ", args["jobs"], "\n");
+            return;
+        }
+    }
+
     std::ifstream f(config_path);
     if (!f.is_open()) {
         LOGFMT(PROJNAME, "build", RED_TEXT("[ERROR]: "), "Could not open config file: ", config_path, "\n");
@@ -67,14 +111,70 @@ void build_project(std::vector<std::string>& input, std::map<std::string, std::s
         ymk::Parser parser(tokens);
         ymk::Workspace ws = parser.parse();
 
-        ymk::build::Builder builder(ws);
-        builder.build(mode);
+        ymk::build::Builder builder(ws, opts);
+        if (!builder.build(mode)) {
+            LOGFMT(PROJNAME, "build", RED_TEXT("[ERROR]: "), "Build failed.\n");
+        }
 
     } catch (const std::exception& e) {
         LOGFMT(PROJNAME, "core", RED_TEXT("FATAL BUILD ERROR: "), e.what(), "\n");
     }
 }
 
+void store_info(std::vector<std::string>& input, std::map<std::string, std::string>& args) {
+    const char* store_env = std::getenv("YMK_STORE");
+    std::string dir = args.count("store") ? args["store"] : (store_env ? store_env : "");
+    if (dir.empty()) {
+        LOGFMT(PROJNAME, "store", RED_TEXT("[ERROR]: "), "No object store, pass -S <dir> or set YMK_STORE\n");
+        return;
+    }
+
+    if (args.count("clear")) {
+        if (!ymk::build::ObjectStore::clear(dir)) {
+            LOGFMT(PROJNAME, "store", RED_TEXT("[ERROR]: "), "Could not clear ", dir, "\n");
+            return;
+        }
+        LLOG(GREEN_TEXT("Cleared "), dir, "\n");
+        return;
+    }
+
+    ymk::build::StoreStats stats;
+    ymk::build::ObjectStore::read_stats(dir, stats);
+
+    u64 lookups = stats.hits + stats.misses;
+    LLOG(PURPLE_TEXT("object store: "), dir, "\n");
+    LLOG("  hits       ", stats.hits, lookups ? " (" + std::to_string(stats.hits * 100 / lookups) + "%)" : "", "\n");
+    LLOG("  misses     ", stats.misses, "\n");
+    LLOG("  stored     ", stats.stores, "\n");
+    LLOG("  evicted    ", stats.evictions, "\n");
+    LLOG("  files      ", stats.files, "\n");
+    LLOG("  size       ", stats.size < (1 << 20) ? std::to_string(stats.size / 1024) + " KiB" : std::to_string(stats.size >> 20) + " MiB", "\n");
+}
+
+void cache_server(std::vector<std::string>& input, std::map<std::string, std::string>& args) {
+    std::string dir = args.count("dir") ? args["dir"] : "ymk-cache";
+
+    u64 port = 8080, jobs = 16, latency = 0;
+    try {
+        if (args.count("port")) port = std::stoul(args["port"]);
+        if (args.count("jobs")) jobs = std::stoul(args["jobs"]);
+        if (args.count("latency")) latency = std::stoul(args["latency"]);
+    } catch (const std::exception&) {
+        LOGFMT(PROJNAME, "cache-server", RED_TEXT("[ERROR]: "), "Invalid number in the arguments\n");
+        return;
+    }
+
+    if (port == 0 || port > 65535) {
+        LOGFMT(PROJNAME, "cache-server", RED_TEXT("[ERROR]: "), "Invalid port: ", port, "\n");
+        return;
+    }
+
+    // unauthenticated PUTs end up in other people's builds, the LAN has to be asked for
+    std::string bind_address = args.count("bind") ? args["bind"] : ymk::HttpServer::LOOPBACK;
+
+    ymk::build::CacheServer::run(dir, bind_address, (u16)port, jobs ? jobs : 1, (u32)latency);
+}
+
 int main(int argc, char *argv[]) {
     LOG_CHANGE_PRIORITY(LOG_WARN);
     
@@ -94,11 +194,43 @@ int main(int argc, char *argv[]) {
         "Builds the project based on the configuration",
         {
             ymk::cli::CommandArgument("config", "Path to config file", "-c", "--config", ymk::cli::ValueType::String),
-            ymk::cli::CommandArgument("mode", "Build configuration mode (e.g., debug, release)", "-m", "--mode", ymk::cli::ValueType::String)
+            ymk::cli::CommandArgument("mode", "Build configuration mode (e.g., debug, release)", "-m", "--mode", ymk::cli::ValueType::String),
+            ymk::cli::CommandArgument("jobs", "Number of parallel compile jobs (default: all cores)", "-j", "--jobs", ymk::cli::ValueType::Int),
+            ymk::cli::CommandArgument("preprocessed", "Compile changed files from the cache check's preprocessed output", "-P", "--preprocessed", ymk::cli::ValueType::Bool),
+            ymk::cli::CommandArgument("normalize", "Ignore line shifts and whitespace when comparing preprocessed output", "-N", "--normalize", ymk::cli::ValueType::Bool),
+            ymk::cli::CommandArgument("relative", "Workspace-relative paths in compile commands, so other checkouts share objects", "-r", "--relative", ymk::cli::ValueType::Bool),
+            ymk::cli::CommandArgument("store", "Object store shared between workspaces (default: $YMK_STORE)", "-S", "--store", ymk::cli::ValueType::String),
+            ymk::cli::CommandArgument("store-size", "Object store size limit, ex: 500M, 5G (default: $YMK_STORE_SIZE or 5G)", "-Z", "--store-size", ymk::cli::ValueType::String),
+            ymk::cli::CommandArgument("remote", "Remote cache url, ex: http://cache:8080/team (default: $YMK_REMOTE)", "-R", "--remote", ymk::cli::ValueType::String),
+            ymk::cli::CommandArgument("remote-readonly", "Fetch from the remote cache but never upload (or $YMK_REMOTE_READONLY=1)", "-O", "--remote-readonly", ymk::cli::ValueType::Bool),
+            ymk::cli::CommandArgument("remote-jobs", "Parallel transfers to the remote cache (default: 4)", "-T", "--remote-jobs", ymk::cli::ValueType::Int)
         },
         build_project
     ));
 
+    commands.push_back(ymk::cli::Command(
+        "store",
+        "Shows the object store's statistics",
+        {
+            ymk::cli::CommandArgument("store", "Object store directory (default: $YMK_STORE)", "-S", "--store", ymk::cli::ValueType::String),
+            ymk::cli::CommandArgument("clear", "Remove every stored object and reset the statistics", "-C", "--clear", ymk::cli::ValueType::Bool)
+        },
+        store_info
+    ));
+
+    commands.push_back(ymk::cli::Command(
+        "cache-server",
+        "Serves a directory as a remote cache (GET/PUT), for tests and measurements",
+        {
+            ymk::cli::CommandArgument("dir", "Where the blobs are kept (default: ./ymk-cache)", "-d", "--dir", ymk::cli::ValueType::String),
+            ymk::cli::CommandArgument("port", "Port to listen on (default: 8080)", "-p", "--port", ymk::cli::ValueType::Int),
+            ymk::cli::CommandArgument("bind", "IPv4 address to listen on, 0.0.0.0 for every interface (default: 127.0.0.1)", "-b", "--bind", ymk::cli::ValueType::String),
+            ymk::cli::CommandArgument("jobs", "Connections served at once (default: 16)", "-j", "--jobs", ymk::cli::ValueType::Int),
+            ymk::cli::CommandArgument("latency", "Delay every request by this many milliseconds", "-l", "--latency", ymk::cli::ValueType::Int)
+        },
+        cache_server
+    ));
+
     commands.push_back(ymk::cli::Command(
         "init", 
         "Generates a default build.ymk template in the current directory",